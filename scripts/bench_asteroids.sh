@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+# Headline benchmark: 10_2_asteroids, drawn per rock and indirect, vs 10_3_asteroids_instanced,
+# with float and packed vertices, by level of detail and frustum culled on the CPU or GPU,
+# and occlusion culled by a Hi-Z pyramid
+#   scripts/bench_asteroids.sh [backend] [warmup] [frames]
+# backend: window, egl, osmesa
+
+BASE_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(realpath "$BASE_DIR/..")
+
+source "$BASE_DIR/common/echo.sh"
+
+BACKEND=${1:-osmesa}
+WARMUP=${2:-30}
+FRAMES=${3:-300}
+
+BIN_DIR="$ROOT_DIR/_output/bin/learnopengl/4_advanced_opengl"
+OUT_DIR="$ROOT_DIR/_output/bench"
+mkdir -p "$OUT_DIR"
+
+RUNS=(
+  10_2_asteroids
+  10_2_asteroids:indirect
+  10_3_asteroids_instanced
+  10_3_asteroids_instanced:packed
+  10_3_asteroids_instanced:lod
+  10_3_asteroids_instanced:cull
+  10_3_asteroids_instanced:gpu
+  10_3_asteroids_instanced:hiz
+)
+
+for run in "${RUNS[@]}"; do
+  name=${run%%:*}
+  variant=${run#"$name"}
+  variant=${variant#:}
+  bin=$(ls "$BIN_DIR/$name"* 2>/dev/null | head -n 1)
+  if [ -z "$bin" ]; then
+    _echo_e "$name not found in $BIN_DIR, build first"
+    exit 1
+  fi
+  out="$OUT_DIR/$name${variant:+_$variant}.json"
+  _echo_s "Bench $name${variant:+ $variant} ($BACKEND, $WARMUP+$FRAMES frames)"
+  ASTEROIDS_DRAW_INDIRECT=$([ "$variant" = indirect ] && echo 1 || echo 0) \
+  ASTEROIDS_PACKED_VERTICES=$([ "$variant" = packed ] && echo 1 || echo 0) \
+  ASTEROIDS_LOD=$([ "$variant" = lod ] && echo 1 || echo 0) \
+  ASTEROIDS_CULL=$(case "$variant" in cull) echo 1;; gpu|hiz) echo "$variant";; *) echo 0;; esac) \
+  GLFW_BASE_BACKEND=$BACKEND \
+  GLFW_BASE_BENCH_WARMUP=$WARMUP \
+  GLFW_BASE_BENCH_FRAMES=$FRAMES \
+  GLFW_BASE_BENCH_OUTPUT="$out" \
+  "$bin" || exit 1
+  cat "$out"
+done
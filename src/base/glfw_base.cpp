@@ -1,7 +1,16 @@
 #include "glfw_base.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 #ifdef __APPLE__
 #define GL_SILENCE_DEPRECATION
@@ -19,10 +28,88 @@ void glfw_framebuffer_size_callback(GLFWwindow *window, int width, int height) {
   glViewport(0, 0, width, height);
 }
 
+// Overrides from the environment, so that every sample could run offscreen:
+//   GLFW_BASE_BACKEND=window|egl|osmesa
+//   GLFW_BASE_FRAMES=N
+//   GLFW_BASE_BENCH_WARMUP=N GLFW_BASE_BENCH_FRAMES=M GLFW_BASE_BENCH_OUTPUT=path
+void glfw_env_params(GlfwInitParams *params) {
+  const char *backend = std::getenv("GLFW_BASE_BACKEND");
+  if (backend && params->backend == GlfwBackend::kWindow) {
+    if (std::strcmp(backend, "egl") == 0) {
+      params->backend = GlfwBackend::kEgl;
+    } else if (std::strcmp(backend, "osmesa") == 0) {
+      params->backend = GlfwBackend::kOSMesa;
+    } else if (std::strcmp(backend, "window") != 0) {
+      std::cerr << "Unknown GLFW_BASE_BACKEND: " << backend << std::endl;
+    }
+  }
+  const char *frames = std::getenv("GLFW_BASE_FRAMES");
+  if (frames && params->frames <= 0) {
+    params->frames = std::atoi(frames);
+  }
+
+  auto &bench = params->benchmark;
+  const char *bench_frames = std::getenv("GLFW_BASE_BENCH_FRAMES");
+  if (bench_frames && bench.frames <= 0) {
+    bench.frames = std::atoi(bench_frames);
+    const char *bench_warmup = std::getenv("GLFW_BASE_BENCH_WARMUP");
+    if (bench_warmup) bench.warmup_frames = std::atoi(bench_warmup);
+  }
+  const char *bench_output = std::getenv("GLFW_BASE_BENCH_OUTPUT");
+  if (bench_output && bench.output.empty()) {
+    bench.output = bench_output;
+  }
+}
+
+const char *glfw_backend_name(GlfwBackend backend) {
+  switch (backend) {
+    case GlfwBackend::kEgl: return "egl";
+    case GlfwBackend::kOSMesa: return "osmesa";
+    default: return "window";
+  }
+}
+
+// Writes s as a quoted JSON string
+void json_string(std::ostream &os, const char *s) {
+  os << '"';
+  for (; s && *s; ++s) {
+    const unsigned char c = static_cast<unsigned char>(*s);
+    if (c == '"' || c == '\\') {
+      os << '\\' << *s;
+    } else if (c < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      os << escaped;
+    } else {
+      os << *s;
+    }
+  }
+  os << '"';
+}
+
+// Writes {"min":..,"median":..,"p99":..,"max":..,"mean":..} in milliseconds
+void json_frame_stats(std::ostream &os, std::vector<double> times) {
+  if (times.empty()) {
+    os << "null";
+    return;
+  }
+  std::sort(times.begin(), times.end());
+  auto n = times.size();
+  double sum = 0;
+  for (auto t : times) sum += t;
+  auto p99 = static_cast<std::size_t>(std::ceil(n * 0.99)) - 1;  // nearest rank
+  os << "{\"min\": " << times.front()
+     << ", \"median\": " << times[n / 2]
+     << ", \"p99\": " << times[p99]
+     << ", \"max\": " << times.back()
+     << ", \"mean\": " << sum / n << "}";
+}
+
 }  // namespace
 
 GlfwBase::GlfwBase()
   : window_(nullptr),
+    init_params_{},
     callback_(nullptr),
     clear_color_(0.f, 0.f, 0.f, 1.f) {
 }
@@ -33,9 +120,18 @@ GlfwBase::~GlfwBase() {
 GLFWwindow *GlfwBase::Init(const GlfwInitParams &params_) {
   if (window_) return window_;
   auto params = DefaultInitParams(params_);
+  init_params_ = params;
 
   // Setup window
   glfwSetErrorCallback(glfw_error_callback);
+  if (IsHeadless()) {
+#ifdef GLFW_PLATFORM_NULL
+    // No display is needed, the context renders into a pbuffer or client memory
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+    std::cerr << "Headless backend needs GLFW 3.4+, a display is still required" << std::endl;
+#endif
+  }
   if (!glfwInit()) {
     std::cerr << "Failed to initialize GLFW" << std::endl;
     return nullptr;
@@ -49,6 +145,19 @@ GLFWwindow *GlfwBase::Init(const GlfwInitParams &params_) {
   } else {
     OnWindowBeforeCreate();
   }
+  // After the callbacks, as they may reset the window hints
+  if (IsHeadless()) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if (params.backend == GlfwBackend::kEgl) {
+      glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    } else {
+#ifdef GLFW_OSMESA_CONTEXT_API
+      glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#else
+      std::cerr << "OSMesa backend needs GLFW 3.3+, using the native context" << std::endl;
+#endif
+    }
+  }
 
   // Create window with graphics context
   GLFWwindow* window = glfwCreateWindow(
@@ -102,6 +211,9 @@ void GlfwBase::Destroy() {
 
   OnDestroy();
   if (callback_) callback_->OnGlfwDestory(this);
+  // Release the callback while its context is current, so that the GL
+  // objects it owns (e.g. Model, Mesh) are freed on a live context
+  callback_.reset();
 
   glfwDestroyWindow(window_);
   glfwTerminate();
@@ -112,6 +224,14 @@ GLFWwindow *GlfwBase::GetWindow() const {
   return window_;
 }
 
+bool GlfwBase::IsHeadless() const {
+  return init_params_.backend != GlfwBackend::kWindow;
+}
+
+bool GlfwBase::IsBenchmark() const {
+  return init_params_.benchmark.frames > 0;
+}
+
 std::string GlfwBase::GetGLSLVersion() const {
   return glsl_version_;
 }
@@ -124,7 +244,15 @@ int GlfwBase::Run(const GlfwInitParams &params, GlfwRunCallback callback) {
   GLFWwindow *glfw_window = Init(params);
   if (!glfw_window) return 1;
 
-  while (!ShouldClose()) {
+  if (IsBenchmark()) {
+    int ret = RunBenchmark(callback);
+    Destroy();
+    return ret;
+  }
+
+  const int frames = init_params_.frames;
+  for (int frame = 0; !ShouldClose(); ++frame) {
+    if (frames > 0 && frame >= frames) break;
     if (callback) callback(this);
     Draw();
   }
@@ -133,6 +261,62 @@ int GlfwBase::Run(const GlfwInitParams &params, GlfwRunCallback callback) {
   return 0;
 }
 
+int GlfwBase::RunBenchmark(GlfwRunCallback callback) {
+  using clock = std::chrono::steady_clock;
+  using ms = std::chrono::duration<double, std::milli>;
+  const auto &bench = init_params_.benchmark;
+
+  // Vsync would clamp every frame to the refresh rate
+  glfwSwapInterval(0);
+
+  // cpu: submission time of the frame, swap included
+  // frame: until glFinish() returns, i.e. the frame is done on the gpu
+  std::vector<double> cpu_times, frame_times;
+  cpu_times.reserve(bench.frames);
+  frame_times.reserve(bench.frames);
+
+  const int total = std::max(bench.warmup_frames, 0) + bench.frames;
+  for (int frame = 0; frame < total && !ShouldClose(); ++frame) {
+    auto t0 = clock::now();
+    if (callback) callback(this);
+    Draw();
+    auto t1 = clock::now();
+    glFinish();
+    auto t2 = clock::now();
+    if (frame < bench.warmup_frames) continue;
+    cpu_times.push_back(ms(t1 - t0).count());
+    frame_times.push_back(ms(t2 - t0).count());
+  }
+
+  std::ostringstream json;
+  json << "{\"title\": ";
+  json_string(json, init_params_.title.c_str());
+  json << ", \"backend\": \"" << glfw_backend_name(init_params_.backend) << "\""
+       << ", \"renderer\": ";
+  json_string(json, reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+  json << ", \"width\": " << init_params_.width
+       << ", \"height\": " << init_params_.height
+       << ", \"warmup_frames\": " << bench.warmup_frames
+       << ", \"frames\": " << cpu_times.size()
+       << ", \"cpu_ms\": ";
+  json_frame_stats(json, cpu_times);
+  json << ", \"frame_ms\": ";
+  json_frame_stats(json, frame_times);
+  json << "}";
+
+  if (bench.output.empty()) {
+    std::cout << json.str() << std::endl;
+  } else {
+    std::ofstream out(bench.output);
+    if (!out) {
+      std::cerr << "Failed to write benchmark: " << bench.output << std::endl;
+      return 1;
+    }
+    out << json.str() << std::endl;
+  }
+  return 0;
+}
+
 void GlfwBase::OnWindowBeforeCreate() {
   // Decide GL+GLSL versions
   glfwWindowHint(GLFW_SAMPLES, 4);
@@ -190,5 +374,6 @@ GlfwInitParams GlfwBase::DefaultInitParams(const GlfwInitParams &params_) {
   if (params.width <= 0) params.width = 1280;
   if (params.height <= 0) params.height = 720;
   if (params.title.empty()) params.title = "Window";
+  glfw_env_params(&params);
   return params;
 }
@@ -26,6 +26,10 @@ class GlfwBase {
 
   void SetCallback(Callback callback);
 
+  const GlfwInitParams &init_params() const { return init_params_; }
+  bool IsHeadless() const;
+  bool IsBenchmark() const;
+
   glm::vec4 clear_color() const { return clear_color_; }
   void set_clear_color(const glm::vec4 &color) { clear_color_ = color; }
 
@@ -46,7 +50,10 @@ class GlfwBase {
  protected:
   GlfwInitParams DefaultInitParams(const GlfwInitParams &params);
 
+  int RunBenchmark(GlfwRunCallback callback);
+
   GLFWwindow *window_;
+  GlfwInitParams init_params_;
   std::string glsl_version_;
 
   Callback callback_;
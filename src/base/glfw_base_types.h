@@ -22,10 +22,31 @@ class GlfwBaseCallback {
   virtual bool IsGlfwDrawOverride(GlfwBase *) { return false; }
 };
 
+// How the GL context is created
+enum class GlfwBackend {
+  kWindow,  // on-screen GLFW window, needs a display
+  kEgl,     // offscreen EGL pbuffer on a surfaceless display
+  kOSMesa,  // offscreen OSMesa software context, e.g. llvmpipe
+};
+
+// Bounded run that reports frame times as json, vsync is forced off
+struct GlfwBenchmarkParams {
+  int warmup_frames = 0;
+  // Measured frames, <= 0 disables the benchmark
+  int frames = 0;
+  // Json file path, empty prints to stdout
+  std::string output;
+};
+
 struct GlfwInitParams {
   int width;
   int height;
   std::string title;
+  // Offscreen backends need GLFW 3.4+ for its null platform
+  GlfwBackend backend = GlfwBackend::kWindow;
+  // Stop Run() after this many frames, <= 0 runs until closed
+  int frames = 0;
+  GlfwBenchmarkParams benchmark{};
 };
 
 using GlfwRunCallback = std::function<void(GlfwBase *)>;
@@ -0,0 +1,262 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr int kDepthBits = 19;
+constexpr std::uint64_t kDepthMask = (std::uint64_t(1) << kDepthBits) - 1;
+// no GL name, so the first packet sets all its state
+constexpr GLuint kUnknown = ~GLuint(0);
+
+// the top bits of a non-negative float order like it, the sign bit is 0
+std::uint64_t depth_bits(float depth) {
+  if (!(depth > 0.0f)) return 0;
+  std::uint32_t bits;
+  std::memcpy(&bits, &depth, sizeof(bits));
+  return (bits >> (31 - kDepthBits)) & kDepthMask;
+}
+
+std::size_t uniform_size(GLenum type) {
+  switch (type) {
+    case GL_INT: return sizeof(GLint);
+    case GL_INT_VEC4: return 4 * sizeof(GLint);
+    default: return 16 * sizeof(float);
+  }
+}
+
+}  // namespace
+
+std::uint64_t RenderQueue::MakeKey(std::uint32_t pass, bool translucent, GLuint program,
+                                   std::uint32_t material, GLuint vao, float depth) {
+  std::uint64_t key = (std::uint64_t(pass & 0xf) << 60) | (std::uint64_t(translucent) << 59);
+  const std::uint64_t p = program & 0xfff, m = material & 0xffff, v = vao & 0xfff;
+  if (translucent) {
+    // back to front, then by state
+    return key | ((kDepthMask - depth_bits(depth)) << 40) | (p << 28) | (m << 12) | v;
+  }
+  // by state, then front to back
+  return key | (p << 47) | (m << 31) | (v << 19) | depth_bits(depth);
+}
+
+void RenderQueue::Begin(std::uint64_t key, GLuint program, GLuint vao, std::uint32_t material) {
+  assert(!recording_ && "RenderQueue: Begin() without a Draw*()");
+  Packet packet{};
+  packet.key = key;
+  packet.program = program;
+  packet.vao = vao;
+  packet.material = material;
+  packet.first_uniform = static_cast<std::uint32_t>(uniforms_.size());
+  packet.first_texture = static_cast<std::uint32_t>(textures_.size());
+  packets_.push_back(packet);
+  recording_ = true;
+}
+
+void RenderQueue::SetInt(GLint location, GLint value) {
+  AddUniform(location, GL_INT, &value, sizeof(value));
+}
+
+void RenderQueue::SetIVec4(GLint location, const glm::ivec4 &value) {
+  AddUniform(location, GL_INT_VEC4, &value[0], 4 * sizeof(GLint));
+}
+
+void RenderQueue::SetMat4(GLint location, const glm::mat4 &value) {
+  AddUniform(location, GL_FLOAT_MAT4, &value[0][0], 16 * sizeof(float));
+}
+
+void RenderQueue::BindTexture(const RenderTexture &texture) {
+  assert(recording_);
+  textures_.push_back(texture);
+  packets_.back().texture_count++;
+}
+
+void RenderQueue::DrawElements(GLenum mode, GLsizei count, std::size_t offset,
+                               GLint base_vertex, GLsizei instances) {
+  assert(recording_);
+  Packet &packet = packets_.back();
+  packet.mode = mode;
+  packet.index_type = GL_UNSIGNED_INT;
+  packet.count = count;
+  packet.instances = instances;
+  packet.offset = offset;
+  packet.base_vertex = base_vertex;
+  recording_ = false;
+}
+
+void RenderQueue::DrawArrays(GLenum mode, GLint first, GLsizei count, GLsizei instances) {
+  assert(recording_);
+  Packet &packet = packets_.back();
+  packet.mode = mode;
+  packet.index_type = 0;
+  packet.count = count;
+  packet.instances = instances;
+  packet.first = first;
+  recording_ = false;
+}
+
+void RenderQueue::Execute() {
+  assert(!recording_ && "RenderQueue: Execute() within a packet");
+  stats_ = RenderQueueStats();
+  if (!packets_.empty()) {
+    Sort();
+    program_ = vao_ = active_unit_ = kUnknown;
+    bound_textures_.clear();
+    set_uniforms_.clear();
+    for (auto &&index : order_) Issue(packets_[index]);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  total_stats_.draws += stats_.draws;
+  total_stats_.state_changes += stats_.state_changes;
+  total_stats_.state_changes_saved += stats_.state_changes_saved;
+  frames_++;
+  packets_.clear();
+  uniforms_.clear();
+  textures_.clear();
+}
+
+void RenderQueue::AddUniform(GLint location, GLenum type, const void *value, std::size_t size) {
+  assert(recording_);
+  if (location < 0) return;
+  Uniform uniform;
+  uniform.location = location;
+  uniform.type = type;
+  std::memcpy(uniform.value, value, size);
+  uniforms_.push_back(uniform);
+  packets_.back().uniform_count++;
+}
+
+// LSD radix sort by bytes, stable so equal keys keep the recording order
+void RenderQueue::Sort() {
+  const std::size_t n = packets_.size();
+  keys_.resize(n);
+  order_.resize(n);
+  keys_tmp_.resize(n);
+  order_tmp_.resize(n);
+  for (std::size_t i = 0; i < n; i++) {
+    keys_[i] = packets_[i].key;
+    order_[i] = static_cast<std::uint32_t>(i);
+  }
+  for (int shift = 0; shift < 64; shift += 8) {
+    std::size_t counts[256] = {};
+    for (auto &&key : keys_) counts[(key >> shift) & 0xff]++;
+    // the same byte in every key, the pass would keep the order
+    if (counts[(keys_[0] >> shift) & 0xff] == n) continue;
+    std::size_t sum = 0;
+    for (auto &&count : counts) {
+      std::size_t c = count;
+      count = sum;
+      sum += c;
+    }
+    for (std::size_t i = 0; i < n; i++) {
+      std::size_t to = counts[(keys_[i] >> shift) & 0xff]++;
+      keys_tmp_[to] = keys_[i];
+      order_tmp_[to] = order_[i];
+    }
+    std::swap(keys_, keys_tmp_);
+    std::swap(order_, order_tmp_);
+  }
+}
+
+void RenderQueue::Issue(const Packet &packet) {
+  std::size_t changes = 0, baseline = 2 + packet.uniform_count;
+
+  if (packet.program != program_) {
+    glUseProgram(program_ = packet.program);
+    changes++;
+  }
+  if (packet.vao != vao_) {
+    glBindVertexArray(vao_ = packet.vao);
+    changes++;
+  }
+
+  // uniforms are program state, so a value set for the program stays
+  auto set_uniform = [this, &packet, &changes](const Uniform &uniform) {
+    const std::size_t size = uniform_size(uniform.type);
+    SetUniform *set = nullptr;
+    for (auto &&s : set_uniforms_) {
+      if (s.program == packet.program && s.uniform.location == uniform.location) set = &s;
+    }
+    if (set && set->uniform.type == uniform.type && std::memcmp(set->uniform.value, uniform.value, size) == 0) return;
+    if (set == nullptr) {
+      set_uniforms_.push_back({packet.program, uniform});
+    } else {
+      set->uniform = uniform;
+    }
+    switch (uniform.type) {
+      case GL_INT: {
+        GLint value;
+        std::memcpy(&value, uniform.value, sizeof(value));
+        glUniform1i(uniform.location, value);
+        break;
+      }
+      case GL_INT_VEC4: {
+        GLint value[4];
+        std::memcpy(value, uniform.value, sizeof(value));
+        glUniform4iv(uniform.location, 1, value);
+        break;
+      }
+      default:
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, uniform.value);
+        break;
+    }
+    changes++;
+  };
+
+  for (std::uint32_t i = 0; i < packet.texture_count; i++) {
+    const RenderTexture &texture = textures_[packet.first_texture + i];
+    baseline += 2;
+    if (texture.location >= 0) {
+      baseline++;
+      Uniform sampler;
+      sampler.location = texture.location;
+      sampler.type = GL_INT;
+      const GLint unit = static_cast<GLint>(texture.unit);
+      std::memcpy(sampler.value, &unit, sizeof(unit));
+      set_uniform(sampler);
+    }
+    BoundTexture *bound = nullptr;
+    for (auto &&b : bound_textures_) {
+      if (b.unit == texture.unit && b.target == texture.target) bound = &b;
+    }
+    if (bound && bound->id == texture.id) continue;
+    if (active_unit_ != texture.unit) {
+      glActiveTexture(GL_TEXTURE0 + (active_unit_ = texture.unit));
+      changes++;
+    }
+    glBindTexture(texture.target, texture.id);
+    changes++;
+    if (bound == nullptr) {
+      bound_textures_.push_back({texture.unit, texture.target, texture.id});
+    } else {
+      bound->id = texture.id;
+    }
+  }
+  for (std::uint32_t i = 0; i < packet.uniform_count; i++) set_uniform(uniforms_[packet.first_uniform + i]);
+
+  if (packet.index_type == 0) {
+    if (packet.instances > 1) {
+      glDrawArraysInstanced(packet.mode, packet.first, packet.count, packet.instances);
+    } else {
+      glDrawArrays(packet.mode, packet.first, packet.count);
+    }
+  } else {
+    const void *indices = reinterpret_cast<const void *>(packet.offset);
+    if (packet.base_vertex != 0) {
+      glDrawElementsInstancedBaseVertex(packet.mode, packet.count, packet.index_type, indices,
+                                        packet.instances, packet.base_vertex);
+    } else if (packet.instances > 1) {
+      glDrawElementsInstanced(packet.mode, packet.count, packet.index_type, indices, packet.instances);
+    } else {
+      glDrawElements(packet.mode, packet.count, packet.index_type, indices);
+    }
+  }
+
+  stats_.draws++;
+  stats_.state_changes += changes;
+  stats_.state_changes_saved += baseline - changes;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec4.hpp"
+
+// A texture a draw binds, and the sampler uniform set to its unit
+struct RenderTexture {
+  GLuint unit;
+  GLenum target;
+  GLuint id;
+  GLint location;  // -1 if the program sets it itself
+};
+
+// State changes of an Execute(), issued ones vs. what issuing every packet's
+// whole state would have taken
+struct RenderQueueStats {
+  std::size_t draws = 0;
+  std::size_t state_changes = 0;
+  std::size_t state_changes_saved = 0;
+};
+
+// Records draws as packets instead of issuing them, sorts them by a 64-bit
+// key and issues them in that order, skipping the program, VAO, texture and
+// uniform changes the packets before already made, e.g.
+//   queue.Begin(RenderQueue::MakeKey(0, false, program, material, vao, depth), program, vao);
+//   queue.SetMat4(model_location, model);
+//   queue.BindTexture({0, GL_TEXTURE_2D, texture, sampler_location});
+//   queue.DrawElements(GL_TRIANGLES, count, offset);
+//   ...
+//   queue.Execute();
+// Key bits, high to low:
+//   pass 4 | translucent 1 | opaque: program 12, material 16, vao 12, depth 19 front to back
+//                          | translucent: depth 19 back to front, program 12, material 16, vao 12
+// Ids wider than their bits only sort less well, the state is compared in full.
+// Uniforms a packet doesn't set must be set on its program before Execute().
+// Must be used on the GL thread.
+class RenderQueue {
+ public:
+  static std::uint64_t MakeKey(std::uint32_t pass, bool translucent, GLuint program,
+                               std::uint32_t material, GLuint vao, float depth);
+
+  // starts a packet, material an id of the textures it binds
+  void Begin(std::uint64_t key, GLuint program, GLuint vao, std::uint32_t material = 0);
+  void SetInt(GLint location, GLint value);
+  void SetIVec4(GLint location, const glm::ivec4 &value);
+  void SetMat4(GLint location, const glm::mat4 &value);
+  void BindTexture(const RenderTexture &texture);
+  // ends the packet, offset in the bound GL_ELEMENT_ARRAY_BUFFER of the VAO
+  void DrawElements(GLenum mode, GLsizei count, std::size_t offset,
+                    GLint base_vertex = 0, GLsizei instances = 1);
+  void DrawArrays(GLenum mode, GLint first, GLsizei count, GLsizei instances = 1);
+
+  // sorts and issues the packets, then clears them
+  void Execute();
+
+  std::size_t size() const { return packets_.size(); }
+  // of the last Execute()
+  const RenderQueueStats &stats() const { return stats_; }
+  // of all of them
+  const RenderQueueStats &total_stats() const { return total_stats_; }
+  std::size_t frames() const { return frames_; }
+
+ private:
+  struct Uniform {
+    GLint location;
+    GLenum type;  // GL_INT, GL_INT_VEC4 or GL_FLOAT_MAT4
+    float value[16];
+  };
+
+  struct Packet {
+    std::uint64_t key;
+    GLuint program;
+    GLuint vao;
+    std::uint32_t material;
+    std::uint32_t first_uniform;
+    std::uint32_t first_texture;
+    std::uint16_t uniform_count;
+    std::uint16_t texture_count;
+    // the draw, arrays if index_type is 0
+    GLenum mode;
+    GLenum index_type;
+    GLsizei count;
+    GLsizei instances;
+    GLint first;  // arrays
+    GLint base_vertex;  // elements
+    std::size_t offset;  // elements
+  };
+
+  void AddUniform(GLint location, GLenum type, const void *value, std::size_t size);
+  void Sort();
+  void Issue(const Packet &packet);
+
+  std::vector<Packet> packets_;
+  std::vector<Uniform> uniforms_;
+  std::vector<RenderTexture> textures_;
+  bool recording_ = false;
+
+  // radix sort of the keys with the packet indices
+  std::vector<std::uint64_t> keys_, keys_tmp_;
+  std::vector<std::uint32_t> order_, order_tmp_;
+
+  // the state Execute() set so far
+  struct BoundTexture {
+    GLuint unit;
+    GLenum target;
+    GLuint id;
+  };
+  struct SetUniform {
+    GLuint program;
+    Uniform uniform;
+  };
+  GLuint program_ = 0;
+  GLuint vao_ = 0;
+  GLuint active_unit_ = 0;
+  std::vector<BoundTexture> bound_textures_;
+  std::vector<SetUniform> set_uniforms_;
+
+  RenderQueueStats stats_;
+  RenderQueueStats total_stats_;
+  std::size_t frames_ = 0;
+};
@@ -162,7 +162,7 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
 
     // get matrix's uniform location and set matrix
     shader_->Use();
-    unsigned int transformLoc = glGetUniformLocation(shader_->ID, "transform");
+    unsigned int transformLoc = shader_->GetUniformLocation("transform");
     glUniformMatrix4fv(transformLoc, 1, GL_FALSE, glm::value_ptr(transform));
 
     // render container
@@ -1,5 +1,7 @@
 #include "base/glfw_base.h"
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #include "common/camera.h"
@@ -23,6 +25,10 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     glEnable(GL_DEPTH_TEST);
 
     cube_.Create();
+
+    // RENDER_QUEUE=1 records the cubes into a RenderQueue, sorted and issued without redundant state
+    const char *queue = std::getenv("RENDER_QUEUE");
+    use_queue_ = queue && std::strcmp(queue, "0") != 0;
   }
 
   bool IsGlfwDrawOverride(GlfwBase *) override { return true; }
@@ -38,7 +44,12 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    cube_.DrawTen(camera.GetPerspectiveMatrix(), camera.GetViewMatrix());
+    if (use_queue_) {
+      cube_.DrawTen(&queue_, camera.GetPerspectiveMatrix(), camera.GetViewMatrix());
+      queue_.Execute();
+    } else {
+      cube_.DrawTen(camera.GetPerspectiveMatrix(), camera.GetViewMatrix());
+    }
 
     // glfw: swap buffers and poll IO events
     glfwSwapBuffers(glfw->GetWindow());
@@ -47,10 +58,18 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
 
   void OnGlfwDestory(GlfwBase *) override {
     cube_.Destory();
+    if (queue_.frames()) {
+      const RenderQueueStats &total = queue_.total_stats();
+      std::cout << "Render queue: " << total.draws / queue_.frames() << " draws, "
+                << total.state_changes / queue_.frames() << " state changes per frame, "
+                << total.state_changes_saved / queue_.frames() << " saved" << std::endl;
+    }
   }
 
  private:
   Cube cube_;
+  bool use_queue_ = false;
+  RenderQueue queue_;
 };
 
 int main(int argc, char const *argv[]) {
@@ -304,8 +304,8 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
 
     // shader configuration
     lighting_shader_.Use();
-    lighting_shader_.SetInt("material.diffuse", 0);
-    lighting_shader_.SetInt("material.specular", 1);
+    lighting_shader_.SetInt(UNIFORM_ID("material.diffuse"), 0);
+    lighting_shader_.SetInt(UNIFORM_ID("material.specular"), 1);
   }
 
   bool IsGlfwDrawOverride(GlfwBase *) override { return true; }
@@ -323,8 +323,8 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
 
     // be sure to activate shader when setting uniforms/drawing objects
     lighting_shader_.Use();
-    lighting_shader_.SetVec3("viewPos", camera.GetCamera().Position);
-    lighting_shader_.SetFloat("material.shininess", 32.0f);
+    lighting_shader_.SetVec3(UNIFORM_ID("viewPos"), camera.GetCamera().Position);
+    lighting_shader_.SetFloat(UNIFORM_ID("material.shininess"), 32.0f);
 
     /*
       Here we set all the uniforms for the 5/6 types of lights we have. We have to set them manually and index
@@ -333,63 +333,63 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
       by using 'Uniform buffer objects', but that is something we'll discuss in the 'Advanced GLSL' tutorial.
     */
     // directional light
-    lighting_shader_.SetVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-    lighting_shader_.SetVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-    lighting_shader_.SetVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-    lighting_shader_.SetVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
+    lighting_shader_.SetVec3(UNIFORM_ID("dirLight.direction"), -0.2f, -1.0f, -0.3f);
+    lighting_shader_.SetVec3(UNIFORM_ID("dirLight.ambient"), 0.05f, 0.05f, 0.05f);
+    lighting_shader_.SetVec3(UNIFORM_ID("dirLight.diffuse"), 0.4f, 0.4f, 0.4f);
+    lighting_shader_.SetVec3(UNIFORM_ID("dirLight.specular"), 0.5f, 0.5f, 0.5f);
     // point light 1
-    lighting_shader_.SetVec3("pointLights[0].position", point_light_positions_[0]);
-    lighting_shader_.SetVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-    lighting_shader_.SetVec3("pointLights[0].diffuse", 0.8f, 0.8f, 0.8f);
-    lighting_shader_.SetVec3("pointLights[0].specular", 1.0f, 1.0f, 1.0f);
-    lighting_shader_.SetFloat("pointLights[0].constant", 1.0f);
-    lighting_shader_.SetFloat("pointLights[0].linear", 0.09);
-    lighting_shader_.SetFloat("pointLights[0].quadratic", 0.032);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[0].position"), point_light_positions_[0]);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[0].ambient"), 0.05f, 0.05f, 0.05f);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[0].diffuse"), 0.8f, 0.8f, 0.8f);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[0].specular"), 1.0f, 1.0f, 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[0].constant"), 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[0].linear"), 0.09);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[0].quadratic"), 0.032);
     // point light 2
-    lighting_shader_.SetVec3("pointLights[1].position", point_light_positions_[1]);
-    lighting_shader_.SetVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-    lighting_shader_.SetVec3("pointLights[1].diffuse", 0.8f, 0.8f, 0.8f);
-    lighting_shader_.SetVec3("pointLights[1].specular", 1.0f, 1.0f, 1.0f);
-    lighting_shader_.SetFloat("pointLights[1].constant", 1.0f);
-    lighting_shader_.SetFloat("pointLights[1].linear", 0.09);
-    lighting_shader_.SetFloat("pointLights[1].quadratic", 0.032);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[1].position"), point_light_positions_[1]);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[1].ambient"), 0.05f, 0.05f, 0.05f);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[1].diffuse"), 0.8f, 0.8f, 0.8f);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[1].specular"), 1.0f, 1.0f, 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[1].constant"), 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[1].linear"), 0.09);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[1].quadratic"), 0.032);
     // point light 3
-    lighting_shader_.SetVec3("pointLights[2].position", point_light_positions_[2]);
-    lighting_shader_.SetVec3("pointLights[2].ambient", 0.05f, 0.05f, 0.05f);
-    lighting_shader_.SetVec3("pointLights[2].diffuse", 0.8f, 0.8f, 0.8f);
-    lighting_shader_.SetVec3("pointLights[2].specular", 1.0f, 1.0f, 1.0f);
-    lighting_shader_.SetFloat("pointLights[2].constant", 1.0f);
-    lighting_shader_.SetFloat("pointLights[2].linear", 0.09);
-    lighting_shader_.SetFloat("pointLights[2].quadratic", 0.032);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[2].position"), point_light_positions_[2]);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[2].ambient"), 0.05f, 0.05f, 0.05f);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[2].diffuse"), 0.8f, 0.8f, 0.8f);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[2].specular"), 1.0f, 1.0f, 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[2].constant"), 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[2].linear"), 0.09);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[2].quadratic"), 0.032);
     // point light 4
-    lighting_shader_.SetVec3("pointLights[3].position", point_light_positions_[3]);
-    lighting_shader_.SetVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-    lighting_shader_.SetVec3("pointLights[3].diffuse", 0.8f, 0.8f, 0.8f);
-    lighting_shader_.SetVec3("pointLights[3].specular", 1.0f, 1.0f, 1.0f);
-    lighting_shader_.SetFloat("pointLights[3].constant", 1.0f);
-    lighting_shader_.SetFloat("pointLights[3].linear", 0.09);
-    lighting_shader_.SetFloat("pointLights[3].quadratic", 0.032);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[3].position"), point_light_positions_[3]);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[3].ambient"), 0.05f, 0.05f, 0.05f);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[3].diffuse"), 0.8f, 0.8f, 0.8f);
+    lighting_shader_.SetVec3(UNIFORM_ID("pointLights[3].specular"), 1.0f, 1.0f, 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[3].constant"), 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[3].linear"), 0.09);
+    lighting_shader_.SetFloat(UNIFORM_ID("pointLights[3].quadratic"), 0.032);
     // spotLight
-    lighting_shader_.SetVec3("spotLight.position", camera.GetCamera().Position);
-    lighting_shader_.SetVec3("spotLight.direction", camera.GetCamera().Front);
-    lighting_shader_.SetVec3("spotLight.ambient", 0.0f, 0.0f, 0.0f);
-    lighting_shader_.SetVec3("spotLight.diffuse", 1.0f, 1.0f, 1.0f);
-    lighting_shader_.SetVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-    lighting_shader_.SetFloat("spotLight.constant", 1.0f);
-    lighting_shader_.SetFloat("spotLight.linear", 0.09);
-    lighting_shader_.SetFloat("spotLight.quadratic", 0.032);
-    lighting_shader_.SetFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-    lighting_shader_.SetFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+    lighting_shader_.SetVec3(UNIFORM_ID("spotLight.position"), camera.GetCamera().Position);
+    lighting_shader_.SetVec3(UNIFORM_ID("spotLight.direction"), camera.GetCamera().Front);
+    lighting_shader_.SetVec3(UNIFORM_ID("spotLight.ambient"), 0.0f, 0.0f, 0.0f);
+    lighting_shader_.SetVec3(UNIFORM_ID("spotLight.diffuse"), 1.0f, 1.0f, 1.0f);
+    lighting_shader_.SetVec3(UNIFORM_ID("spotLight.specular"), 1.0f, 1.0f, 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("spotLight.constant"), 1.0f);
+    lighting_shader_.SetFloat(UNIFORM_ID("spotLight.linear"), 0.09);
+    lighting_shader_.SetFloat(UNIFORM_ID("spotLight.quadratic"), 0.032);
+    lighting_shader_.SetFloat(UNIFORM_ID("spotLight.cutOff"), glm::cos(glm::radians(12.5f)));
+    lighting_shader_.SetFloat(UNIFORM_ID("spotLight.outerCutOff"), glm::cos(glm::radians(15.0f)));
 
     // view/projection transformations
     glm::mat4 projection = camera.GetPerspectiveMatrix();
     glm::mat4 view = camera.GetViewMatrix();
-    lighting_shader_.SetMat4("projection", projection);
-    lighting_shader_.SetMat4("view", view);
+    lighting_shader_.SetMat4(UNIFORM_ID("projection"), projection);
+    lighting_shader_.SetMat4(UNIFORM_ID("view"), view);
 
     // world transformation
     glm::mat4 model = glm::mat4(1.0f);
-    lighting_shader_.SetMat4("model", model);
+    lighting_shader_.SetMat4(UNIFORM_ID("model"), model);
 
     // bind diffuse map
     glActiveTexture(GL_TEXTURE0);
@@ -406,22 +406,22 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
       model = glm::translate(model, cube_positions_[i]);
       float angle = 20.0f * i;
       model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-      lighting_shader_.SetMat4("model", model);
+      lighting_shader_.SetMat4(UNIFORM_ID("model"), model);
 
       glDrawArrays(GL_TRIANGLES, 0, 36);
     }
 
     // also draw the lamp object
     lamp_shader_.Use();
-    lamp_shader_.SetMat4("projection", projection);
-    lamp_shader_.SetMat4("view", view);
+    lamp_shader_.SetMat4(UNIFORM_ID("projection"), projection);
+    lamp_shader_.SetMat4(UNIFORM_ID("view"), view);
     // we now draw as many light bulbs as we have point lights.
     glBindVertexArray(light_vao_);
     for (unsigned int i = 0; i < 4; i++) {
       model = glm::mat4(1.0f);
       model = glm::translate(model, point_light_positions_[i]);
       model = glm::scale(model, glm::vec3(0.2f));  // Make it a smaller cube
-      lamp_shader_.SetMat4("model", model);
+      lamp_shader_.SetMat4(UNIFORM_ID("model"), model);
       glDrawArrays(GL_TRIANGLES, 0, 36);
     }
 
@@ -23,8 +23,11 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     // configure global opengl state
     glEnable(GL_DEPTH_TEST);
 
-    our_shader_.Create(
-    R"vs(
+    our_model_.Create(MY_DIR "/objects/nanosuit/nanosuit.obj");
+    // pack the textures into arrays, so the model binds them once instead of per mesh
+    bool packed = our_model_.PackTextures();
+
+    const char *vertex_shader = R"vs(
       #version 330 core
       layout (location = 0) in vec3 aPos;
       layout (location = 1) in vec3 aNormal;
@@ -40,25 +43,41 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
         TexCoords = aTexCoords;
         gl_Position = projection * view * model * vec4(aPos, 1.0);
       }
-    )vs",
-    R"fs(
-      #version 330 core
-      out vec4 FragColor;
-
-      struct Material {
-        sampler2D texture_diffuse1;
-      };
-
-      in vec2 TexCoords;
-
-      uniform Material material;
-
-      void main() {
-        FragColor = texture(material.texture_diffuse1, TexCoords);
-      }
-    )fs");
-
-    our_model_.Create(MY_DIR "/objects/nanosuit/nanosuit.obj");
+    )vs";
+    if (packed) {
+      our_shader_.Create(vertex_shader,
+      R"fs(
+        #version 330 core
+        out vec4 FragColor;
+
+        in vec2 TexCoords;
+
+        uniform sampler2DArray texture_diffuse_array;
+        uniform ivec4 texture_layers;
+
+        void main() {
+          FragColor = texture(texture_diffuse_array, vec3(TexCoords, texture_layers.x));
+        }
+      )fs");
+    } else {
+      our_shader_.Create(vertex_shader,
+      R"fs(
+        #version 330 core
+        out vec4 FragColor;
+
+        struct Material {
+          sampler2D texture_diffuse1;
+        };
+
+        in vec2 TexCoords;
+
+        uniform Material material;
+
+        void main() {
+          FragColor = texture(material.texture_diffuse1, TexCoords);
+        }
+      )fs");
+    }
 
     // draw in wireframe
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -1,5 +1,8 @@
 #include "base/glfw_base.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <vector>
 
 #include "common/camera.h"
@@ -84,6 +87,56 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
       // 4. now add to list of matrices
       rock_matrices_[i] = model;
     }
+
+    // ASTEROIDS_DRAW_INDIRECT=1 draws all the rocks at once from a GL_DRAW_INDIRECT_BUFFER,
+    // each draw fetching its matrix by its draw id, instead of a draw call per rock
+    const char *indirect = std::getenv("ASTEROIDS_DRAW_INDIRECT");
+    if (indirect && std::strcmp(indirect, "0") != 0 && rock_.PackTextures()) {
+      batch_shader_.Create(
+      R"vs(
+        #version 330 core
+        layout (location = 0) in vec3 aPos;
+        layout (location = 2) in vec2 aTexCoords;
+        layout (location = 7) in uint aDrawId;
+
+        out vec2 TexCoords;
+        flat out int Layer;
+
+        uniform mat4 projection;
+        uniform mat4 view;
+        uniform samplerBuffer draw_data;
+
+        void main() {
+          int texel = int(aDrawId) * 5;
+          mat4 model = mat4(texelFetch(draw_data, texel), texelFetch(draw_data, texel + 1),
+                            texelFetch(draw_data, texel + 2), texelFetch(draw_data, texel + 3));
+          Layer = int(texelFetch(draw_data, texel + 4).x);
+          TexCoords = aTexCoords;
+          gl_Position = projection * view * model * vec4(aPos, 1.0f);
+        }
+      )vs",
+      R"fs(
+        #version 330 core
+        out vec4 FragColor;
+
+        in vec2 TexCoords;
+        flat in int Layer;
+
+        uniform sampler2DArray texture_diffuse_array;
+
+        void main() {
+          FragColor = texture(texture_diffuse_array, vec3(TexCoords, Layer));
+        }
+      )fs");
+      batch_.reset(new DrawBatch());
+      for (GLuint i = 0; i < rock_amount_; i++) rock_.AddTo(batch_.get(), rock_matrices_[i]);
+      std::cout << "Draw indirect: " << batch_->size() << " draws in " << batch_->draw_calls()
+                << (batch_->indirect() ? " glMultiDrawElementsIndirect" : " glDrawElementsBaseVertex")
+                << " calls" << std::endl;
+    }
+    // RENDER_QUEUE=1 records the draws into a RenderQueue instead, sorted and issued without redundant state
+    const char *queue = std::getenv("RENDER_QUEUE");
+    use_queue_ = queue && std::strcmp(queue, "0") != 0 && !batch_;
   }
 
   bool IsGlfwDrawOverride(GlfwBase *) override { return true; }
@@ -103,19 +156,34 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     glm::mat4 projection = camera.GetPerspectiveMatrix(0.1f, 1000.0f);
     glm::mat4 view = camera.GetViewMatrix();
     shader_.Use();
-    shader_.SetMat4("projection", projection);
-    shader_.SetMat4("view", view);
+    shader_.SetMat4(UNIFORM_ID("projection"), projection);
+    shader_.SetMat4(UNIFORM_ID("view"), view);
 
     // draw planet
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.0f, -3.0f, 0.0f));
     model = glm::scale(model, glm::vec3(4.0f, 4.0f, 4.0f));
-    shader_.SetMat4("model", model);
-    planet_.Draw(shader_);
+    if (use_queue_) {
+      planet_.Draw(shader_, &queue_, model, glm::length(glm::vec3(view * model[3])));
+    } else {
+      shader_.SetMat4(UNIFORM_ID("model"), model);
+      planet_.Draw(shader_);
+    }
 
     // draw meteorites
-    for (GLuint i = 0; i < rock_amount_; i++) {
-      shader_.SetMat4("model", rock_matrices_[i]);
+    if (batch_) {
+      batch_shader_.Use();
+      batch_shader_.SetMat4(UNIFORM_ID("projection"), projection);
+      batch_shader_.SetMat4(UNIFORM_ID("view"), view);
+      rock_.BindTextureArrays(batch_shader_);
+      batch_->Draw(batch_shader_);
+    }
+    for (GLuint i = 0; i < rock_amount_ && use_queue_; i++) {
+      rock_.Draw(shader_, &queue_, rock_matrices_[i], glm::length(glm::vec3(view * rock_matrices_[i][3])));
+    }
+    if (use_queue_) queue_.Execute();
+    for (GLuint i = 0; i < rock_amount_ && !batch_ && !use_queue_; i++) {
+      shader_.SetMat4(UNIFORM_ID("model"), rock_matrices_[i]);
       rock_.Draw(shader_);
     }
 
@@ -125,10 +193,21 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
   }
 
   void OnGlfwDestory(GlfwBase *) override {
+    batch_.reset();
+    if (queue_.frames()) {
+      const RenderQueueStats &total = queue_.total_stats();
+      std::cout << "Render queue: " << total.draws / queue_.frames() << " draws, "
+                << total.state_changes / queue_.frames() << " state changes per frame, "
+                << total.state_changes_saved / queue_.frames() << " saved" << std::endl;
+    }
   }
 
  private:
   Shader shader_;
+  Shader batch_shader_;
+  std::unique_ptr<DrawBatch> batch_;
+  bool use_queue_ = false;
+  RenderQueue queue_;
 
   Model rock_;
   Model planet_;
@@ -1,8 +1,17 @@
 #include "base/glfw_base.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <vector>
 
 #include "common/camera.h"
+#include "common/frustum_cull.h"
+#include "common/gpu_cull.h"
+#include "common/lod_selector.h"
 #include "common/model.h"
 #include "common/shader.h"
 
@@ -23,10 +32,13 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     // configure global opengl state
     glEnable(GL_DEPTH_TEST);
 
-    asteroid_shader_.Create(
+    // submit the programs, they compile while the models are loading
+    ShaderBatch shader_batch;
+    // the rock is read as a PackedVertex or a Vertex alike, see PACKED_VERTEX_GLSL
+    shader_batch.Add(&asteroid_shader_,
+    "#version 330 core\n" PACKED_VERTEX_GLSL
     R"vs(
-      #version 330 core
-      layout (location = 0) in vec3 aPos;
+      layout (location = 0) in vec4 aPos;
       layout (location = 2) in vec2 aTexCoords;
       layout (location = 3) in mat4 aInstanceMatrix;
 
@@ -34,10 +46,11 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
 
       uniform mat4 projection;
       uniform mat4 view;
+      uniform mat4 position_dequant;
 
       void main() {
         TexCoords = aTexCoords;
-        gl_Position = projection * view * aInstanceMatrix * vec4(aPos, 1.0f);
+        gl_Position = projection * view * aInstanceMatrix * vec4(DecodePosition(position_dequant, aPos), 1.0f);
       }
     )vs",
     R"fs(
@@ -52,7 +65,7 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
         FragColor = texture(texture_diffuse1, TexCoords);
       }
     )fs");
-    planet_shader_.Create(
+    shader_batch.Add(&planet_shader_,
     R"vs(
       #version 330 core
       layout (location = 0) in vec3 aPos;
@@ -81,13 +94,29 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
         FragColor = texture(texture_diffuse1, TexCoords);
       }
     )fs");
+    // ASTEROIDS_CULL=gpu culls in a compute pass instead, that writes the instance counts of indirect draws,
+    // ASTEROIDS_CULL=hiz also drops the rocks behind the depth of the last frame, mostly the planet
+    const char *cull = std::getenv("ASTEROIDS_CULL");
+    if (cull && (std::strcmp(cull, "gpu") == 0 || std::strcmp(cull, "hiz") == 0)) {
+      if (GpuInstanceCull::IsSupported()) {
+        gpu_cull_ = true;
+        gpu_instance_cull_.Submit(&shader_batch, std::strcmp(cull, "hiz") == 0);
+      } else {
+        std::cout << "Asteroids: GPU culling needs GL 4.3 compute shaders, culling on the CPU" << std::endl;
+      }
+    }
 
-    rock_.Create(MY_DIR "/objects/rock/rock.obj");
+    // ASTEROIDS_PACKED_VERTICES=1 quantizes the rock to 20 byte vertices, for the vertex fetch of the 100k instances
+    const char *packed = std::getenv("ASTEROIDS_PACKED_VERTICES");
+    rock_.Create(MY_DIR "/objects/rock/rock.obj", false, packed && std::strcmp(packed, "0") != 0);
+    std::cout << "Asteroids: rock vertices of "
+              << (rock_.packedVertices ? sizeof(PackedVertex) : sizeof(Vertex)) << " bytes" << std::endl;
     planet_.Create(MY_DIR "/objects/planet/planet.obj");
+    shader_batch.Finish();
 
     // generate a large list of semi-random model transformation matrices
     rock_amount_ = 100000;
-    rock_matrices_.reserve(rock_amount_);
+    rock_matrices_.resize(rock_amount_);
     srand(glfwGetTime());  // initialize random seed
     float radius = 150.0;
     float offset = 25.0f;
@@ -115,34 +144,71 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
       rock_matrices_[i] = model;
     }
 
+    // ASTEROIDS_LOD=1 draws each rock at the level of detail its screen-space error allows,
+    // the instances are sorted by level into the instance buffer every frame
+    const char *lod = std::getenv("ASTEROIDS_LOD");
+    lod_ = lod && std::strcmp(lod, "0") != 0;
+    // ASTEROIDS_CULL=1 tests the rocks' bounding spheres against the frustum with SIMD, and streams only the visible ones
+    cull_ = cull && std::strcmp(cull, "0") != 0 && !gpu_cull_;
+    if (gpu_cull_ && lod_) {
+      std::cout << "Asteroids: GPU culling draws LOD 0 only" << std::endl;
+      lod_ = false;
+    }
+    if (lod_ || cull_) {
+      rock_scales_.resize(rock_amount_);
+      for (GLuint i = 0; i < rock_amount_; i++) {
+        const glm::mat4 &m = rock_matrices_[i];
+        rock_scales_[i] = std::max(glm::length(glm::vec3(m[0])),
+                                   std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+      }
+      // all rocks, until culled
+      visible_.resize(rock_amount_ + 8);
+      for (GLuint i = 0; i < rock_amount_; i++) visible_[i] = i;
+      visible_count_ = rock_amount_;
+    }
+    glm::vec4 bounds = rock_.meshes[0].bounds;
+    for (auto &&mesh : rock_.meshes) bounds = MergeSpheres(bounds, mesh.bounds);
+    if (cull_) {
+      for (GLuint i = 0; i < rock_amount_; i++) {
+        glm::vec3 center(rock_matrices_[i] * glm::vec4(glm::vec3(bounds), 1.0f));
+        rock_spheres_.Add(center, bounds.w * rock_scales_[i]);
+      }
+    }
+    if (lod_) {
+      for (auto &&mesh : rock_.meshes) {
+        std::cout << "Asteroids: rock LODs";
+        for (int l = 0; l < mesh.LodCount(); l++) {
+          std::cout << " " << mesh.Lod(l).index_count / 3 << " (" << mesh.Lod(l).error << ")";
+        }
+        std::cout << std::endl;
+      }
+    }
+
     // configure instanced array
-    GLuint buffer;
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, rock_amount_ * sizeof(glm::mat4), &rock_matrices_[0], GL_STATIC_DRAW);
+    glGenBuffers(1, &instance_buffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+    glBufferData(GL_ARRAY_BUFFER, rock_amount_ * sizeof(glm::mat4), &rock_matrices_[0],
+                 lod_ || cull_ ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+
+    if (gpu_cull_) {
+      // the compute pass reads the matrices as they are and the draws the visible ones
+      gpu_instance_cull_.Setup(instance_buffer_, rock_amount_, bounds);
+      for (auto &&mesh : rock_.meshes) gpu_instance_cull_.AddDraw(mesh);
+    }
 
     // set transformation matrices as an instance vertex attribute (with divisor 1)
-    // note: we're cheating a little by taking the, now publicly declared, VAO of the model's mesh(es) and adding new vertexAttribPointers
-    // normally you'd want to do this in a more organized fashion, but for learning purposes this will do.
+    // the meshes share the VAO of the vertex pool, so build our own over the same buffers and add the attributes there.
     for (GLuint i = 0; i < rock_.meshes.size(); i++) {
-      GLuint VAO = rock_.meshes[i].VAO;
+      GLuint VAO = rock_.meshes[i].CreateVertexArray();
       glBindVertexArray(VAO);
-      // set attribute pointers for matrix (4 times vec4)
-      glEnableVertexAttribArray(3);
-      glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-      glEnableVertexAttribArray(4);
-      glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
-      glEnableVertexAttribArray(5);
-      glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-      glEnableVertexAttribArray(6);
-      glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
+      SetInstanceMatrices(gpu_cull_ ? gpu_instance_cull_.visible_buffer() : instance_buffer_, 0);
       glVertexAttribDivisor(3, 1);
       glVertexAttribDivisor(4, 1);
       glVertexAttribDivisor(5, 1);
       glVertexAttribDivisor(6, 1);
 
       glBindVertexArray(0);
+      rock_vaos_.push_back(VAO);
     }
   }
 
@@ -162,45 +228,168 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     // configure transformation matrices
     glm::mat4 projection = camera.GetPerspectiveMatrix(0.1f, 1000.0f);
     glm::mat4 view = camera.GetViewMatrix();
+    // first, the rocks' compute pass may run along the planet
+    if (gpu_cull_) gpu_instance_cull_.Cull(projection * view);
     asteroid_shader_.Use();
-    asteroid_shader_.SetMat4("projection", projection);
-    asteroid_shader_.SetMat4("view", view);
+    asteroid_shader_.SetMat4(UNIFORM_ID("projection"), projection);
+    asteroid_shader_.SetMat4(UNIFORM_ID("view"), view);
     planet_shader_.Use();
-    planet_shader_.SetMat4("projection", projection);
-    planet_shader_.SetMat4("view", view);
+    planet_shader_.SetMat4(UNIFORM_ID("projection"), projection);
+    planet_shader_.SetMat4(UNIFORM_ID("view"), view);
 
     // draw planet
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::translate(model, glm::vec3(0.0f, -3.0f, 0.0f));
     model = glm::scale(model, glm::vec3(4.0f, 4.0f, 4.0f));
-    planet_shader_.SetMat4("model", model);
+    planet_shader_.SetMat4(UNIFORM_ID("model"), model);
     planet_.Draw(planet_shader_);
 
     // draw meteorites
     asteroid_shader_.Use();
-    asteroid_shader_.SetInt("texture_diffuse1", 0);
+    asteroid_shader_.SetInt(UNIFORM_ID("texture_diffuse1"), 0);
+    GLint dequant = asteroid_shader_.GetUniformLocation(UNIFORM_ID("position_dequant"));
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, rock_.textures_loaded[0].id);  // note: we also made the textures_loaded vector public (instead of private) from the model class.
+    if (cull_) {
+      auto start = std::chrono::steady_clock::now();
+      visible_count_ = CullSpheres(Frustum::FromMatrix(projection * view), rock_spheres_, visible_.data());
+      cull_time_ += std::chrono::steady_clock::now() - start;
+      cull_visible_ += visible_count_;
+      cull_frames_++;
+    }
+    int viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    LodSelector selector(projection, static_cast<float>(viewport[3]));
     for (GLuint i = 0; i < rock_.meshes.size(); i++) {
-      glBindVertexArray(rock_.meshes[i].VAO);
-      glDrawElementsInstanced(GL_TRIANGLES, rock_.meshes[i].indices.size(), GL_UNSIGNED_INT, 0, rock_amount_);
+      glUniformMatrix4fv(dequant, 1, GL_FALSE, &rock_.meshes[i].position_dequant[0][0]);
+      glBindVertexArray(rock_vaos_[i]);
+      if (gpu_cull_) {
+        gpu_instance_cull_.Draw(i);
+      } else if (lod_ || cull_) {
+        DrawInstances(rock_.meshes[i], lod_ ? &selector : nullptr, camera.GetCamera().Position);
+      } else {
+        rock_.meshes[i].DrawElements(rock_amount_);
+      }
       glBindVertexArray(0);
     }
 
+    // the depth for the occlusion of the next frame
+    if (gpu_cull_) gpu_instance_cull_.UpdateHiZ(projection * view, viewport[2], viewport[3]);
+
     // glfw: swap buffers and poll IO events
     glfwSwapBuffers(glfw->GetWindow());
     glfwPollEvents();
   }
 
   void OnGlfwDestory(GlfwBase *) override {
+    if (!rock_vaos_.empty()) glDeleteVertexArrays(rock_vaos_.size(), rock_vaos_.data());
+    if (gpu_cull_ && gpu_instance_cull_.cull_count()) {
+      std::cout << "Asteroids: GPU culled, " << 100.0 * gpu_instance_cull_.ReadVisibleCount() / rock_amount_
+                << "% visible in the last frame" << std::endl;
+      if (gpu_instance_cull_.occlusion() && gpu_instance_cull_.hiz_cull_count()) {
+        const GLuint occluded = gpu_instance_cull_.ReadOccludedCount();
+        std::cout << "Asteroids: Hi-Z occluded " << occluded << " instances in the last frame, "
+                  << 100.0 * occluded / rock_amount_ << "%" << std::endl;
+      }
+    }
+    glDeleteBuffers(1, &instance_buffer_);
+    if (cull_frames_) {
+      double ms = std::chrono::duration<double, std::milli>(cull_time_).count() / cull_frames_;
+      std::cout << "Asteroids: culled in " << ms * 100000.0 / rock_amount_ << " ms per 100k instances, "
+                << 100.0 * cull_visible_ / (static_cast<double>(cull_frames_) * rock_amount_) << "% visible"
+                << std::endl;
+    }
+    if (lod_ && lod_frames_) {
+      std::cout << "Asteroids: instances per LOD per frame";
+      for (auto &&count : lod_instances_) std::cout << " " << count / lod_frames_;
+      std::cout << ", triangles " << lod_triangles_ / lod_frames_ << std::endl;
+    }
   }
 
  private:
+  // points the instance matrix attributes 3-6 of the bound VAO at the buffer of matrices
+  void SetInstanceMatrices(GLuint buffer, std::size_t first_instance) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    const std::size_t offset = first_instance * sizeof(glm::mat4);
+    // set attribute pointers for matrix (4 times vec4)
+    for (GLuint column = 0; column < 4; column++) {
+      glEnableVertexAttribArray(3 + column);
+      glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                            (void*)(offset + column * sizeof(glm::vec4)));
+    }
+  }
+
+  // sorts the visible rocks by their level of detail, all at 0 without a
+  // selector, into the instance buffer, and draws the instances of each
+  // level, the mesh's VAO bound
+  void DrawInstances(const Mesh &mesh, const LodSelector *selector, const glm::vec3 &eye) {
+    const int lod_count = selector ? mesh.LodCount() : 1;
+    rock_lods_.resize(rock_amount_);
+    std::vector<GLuint> first(lod_count + 1, 0);
+    for (std::size_t v = 0; v < visible_count_; v++) {
+      GLuint i = visible_[v];
+      if (selector) {
+        float distance = glm::length(glm::vec3(rock_matrices_[i][3]) - eye);
+        rock_lods_[i] = static_cast<unsigned char>(selector->Select(mesh, distance, rock_scales_[i]));
+      } else {
+        rock_lods_[i] = 0;
+      }
+      first[rock_lods_[i] + 1]++;
+    }
+    for (int l = 0; l < lod_count; l++) first[l + 1] += first[l];
+    sorted_matrices_.resize(rock_amount_);
+    std::vector<GLuint> next(first.begin(), first.end() - 1);
+    for (std::size_t v = 0; v < visible_count_; v++) {
+      GLuint i = visible_[v];
+      sorted_matrices_[next[rock_lods_[i]]++] = rock_matrices_[i];
+    }
+
+    // orphan the buffer, the last frame may still read it
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+    glBufferData(GL_ARRAY_BUFFER, rock_amount_ * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, visible_count_ * sizeof(glm::mat4), sorted_matrices_.data());
+    if (lod_instances_.size() < static_cast<std::size_t>(lod_count)) lod_instances_.resize(lod_count, 0);
+    for (int l = 0; l < lod_count; l++) {
+      GLuint count = first[l + 1] - first[l];
+      lod_instances_[l] += count;
+      lod_triangles_ += static_cast<std::uint64_t>(count) * (mesh.Lod(l).index_count / 3);
+      if (count == 0) continue;
+      SetInstanceMatrices(instance_buffer_, first[l]);
+      mesh.DrawElements(count, l);
+    }
+    // the attributes as they were set up, for the other meshes
+    SetInstanceMatrices(instance_buffer_, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    lod_frames_++;
+  }
+
   Shader asteroid_shader_;
   Shader planet_shader_;
 
   Model rock_;
   Model planet_;
+  // the rock meshes with the instance matrices
+  std::vector<GLuint> rock_vaos_;
+  GLuint instance_buffer_ = 0;
+
+  // levels of detail and culling, see DrawInstances()
+  bool lod_ = false;
+  bool cull_ = false;
+  std::vector<float> rock_scales_;
+  SphereSoA rock_spheres_;
+  std::vector<std::uint32_t> visible_;
+  std::size_t visible_count_ = 0;
+  std::chrono::steady_clock::duration cull_time_{};
+  std::uint64_t cull_visible_ = 0;
+  std::uint64_t cull_frames_ = 0;
+  std::vector<unsigned char> rock_lods_;
+  std::vector<glm::mat4> sorted_matrices_;
+  std::vector<std::uint64_t> lod_instances_;
+  std::uint64_t lod_triangles_ = 0;
+  std::uint64_t lod_frames_ = 0;
+  // or culling in a compute pass, drawn indirect
+  bool gpu_cull_ = false;
+  GpuInstanceCull gpu_instance_cull_;
 
   GLuint rock_amount_;
   std::vector<glm::mat4> rock_matrices_;
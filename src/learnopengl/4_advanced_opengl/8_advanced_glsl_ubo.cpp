@@ -37,7 +37,9 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
       }
     )vs";
 
-    shader_red_.Create(vertexShaderCode,
+    // submit all programs, they compile while the vertex data is set up
+    ShaderBatch shader_batch;
+    shader_batch.Add(&shader_red_, vertexShaderCode,
     R"fs(
       #version 330 core
       out vec4 FragColor;
@@ -45,7 +47,7 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
         FragColor = vec4(1.0, 0.0, 0.0, 1.0);
       }
     )fs");
-    shader_green_.Create(vertexShaderCode,
+    shader_batch.Add(&shader_green_, vertexShaderCode,
     R"fs(
       #version 330 core
       out vec4 FragColor;
@@ -53,7 +55,7 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
         FragColor = vec4(0.0, 1.0, 0.0, 1.0);
       }
     )fs");
-    shader_blue_.Create(vertexShaderCode,
+    shader_batch.Add(&shader_blue_, vertexShaderCode,
     R"fs(
       #version 330 core
       out vec4 FragColor;
@@ -61,7 +63,7 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
         FragColor = vec4(0.0, 0.0, 1.0, 1.0);
       }
     )fs");
-    shader_yellow_.Create(vertexShaderCode,
+    shader_batch.Add(&shader_yellow_, vertexShaderCode,
     R"fs(
       #version 330 core
       out vec4 FragColor;
@@ -124,6 +126,9 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
+    // wait for the programs, their IDs are valid from here
+    shader_batch.Finish();
+
     // configure a uniform buffer object
     // first. We get the relevant block indices
     GLuint uniformBlockIndexRed = glGetUniformBlockIndex(shader_red_.ID, "Matrices");
@@ -125,9 +125,9 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     glBindVertexArray(0);
 
-    // load textures
-    floor_texture_                 = LoadTexture(MY_DIR "/textures/wood.png", false);
-    floor_texture_gamma_corrected_ = LoadTexture(MY_DIR "/textures/wood.png", true);
+    // load textures, streamed in while rendering
+    floor_texture_                 = LoadTexture(MY_DIR "/textures/wood.png", false, true);
+    floor_texture_gamma_corrected_ = LoadTexture(MY_DIR "/textures/wood.png", true, true);
 
     // shader configuration
     shader_.Use();
@@ -164,6 +164,9 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
       gamma_key_pressed_ = false;
     }
 
+    // upload the textures decoded so far
+    TextureStreamer::Instance().Update();
+
     // render
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -175,8 +178,8 @@ class GlfwBaseCallbackImpl : public GlfwBaseCallback {
     shader_.SetMat4("projection", projection);
     shader_.SetMat4("view", view);
     // set light uniforms
-    glUniform3fv(glGetUniformLocation(shader_.ID, "lightPositions"), 4, &light_positions_[0][0]);
-    glUniform3fv(glGetUniformLocation(shader_.ID, "lightColors"), 4, &light_colors_[0][0]);
+    glUniform3fv(shader_.GetUniformLocation("lightPositions"), 4, &light_positions_[0][0]);
+    glUniform3fv(shader_.GetUniformLocation("lightColors"), 4, &light_colors_[0][0]);
     shader_.SetVec3("viewPos", camera.GetCamera().Position);
     shader_.SetInt("gamma", gamma_enabled_);
     // floor
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// CPU encoding and decoding of the BC1-5 (S3TC/RGTC) block formats. A block
+// is 4x4 texels, 8 bytes for BC1/BC4 and 16 bytes for BC2/BC3/BC5.
+//
+// The encoder is a fast range fit for the offline converter, not a high
+// quality one. The decoder backs the upload on drivers without the formats.
+
+enum class BlockFormat {
+  kBC1,  // RGB(A1)
+  kBC2,  // RGB + explicit 4-bit alpha
+  kBC3,  // RGB + interpolated alpha
+  kBC4,  // R
+  kBC5,  // RG
+};
+
+inline int BlockBytes(BlockFormat format) {
+  return (format == BlockFormat::kBC1 || format == BlockFormat::kBC4) ? 8 : 16;
+}
+
+inline std::size_t BlockImageBytes(BlockFormat format, int width, int height) {
+  return static_cast<std::size_t>((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+namespace bc {
+
+inline std::uint16_t Pack565(const int c[3]) {
+  return static_cast<std::uint16_t>(((c[0] * 31 + 127) / 255) << 11 |
+                                    ((c[1] * 63 + 127) / 255) << 5 |
+                                    ((c[2] * 31 + 127) / 255));
+}
+
+inline void Unpack565(std::uint16_t v, int c[3]) {
+  int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// color block of 16 RGBA texels
+inline void EncodeColorBlock(const std::uint8_t texels[16][4], std::uint8_t *out) {
+  // endpoints are the extremes along the bounding box diagonal
+  int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < 3; c++) {
+      lo[c] = std::min<int>(lo[c], texels[i][c]);
+      hi[c] = std::max<int>(hi[c], texels[i][c]);
+    }
+  }
+  int axis[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+  int min_i = 0, max_i = 0, min_d = 1 << 30, max_d = -(1 << 30);
+  for (int i = 0; i < 16; i++) {
+    int d = texels[i][0] * axis[0] + texels[i][1] * axis[1] + texels[i][2] * axis[2];
+    if (d < min_d) { min_d = d; min_i = i; }
+    if (d > max_d) { max_d = d; max_i = i; }
+  }
+  int c0[3] = {texels[max_i][0], texels[max_i][1], texels[max_i][2]};
+  int c1[3] = {texels[min_i][0], texels[min_i][1], texels[min_i][2]};
+  std::uint16_t v0 = Pack565(c0), v1 = Pack565(c1);
+
+  std::uint32_t indices = 0;
+  if (v0 != v1) {
+    if (v0 < v1) std::swap(v0, v1);  // 4 color mode
+    int palette[4][3];
+    Unpack565(v0, palette[0]);
+    Unpack565(v1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < 16; i++) {
+      int best = 0, best_d = 1 << 30;
+      for (int p = 0; p < 4; p++) {
+        int dr = texels[i][0] - palette[p][0];
+        int dg = texels[i][1] - palette[p][1];
+        int db = texels[i][2] - palette[p][2];
+        int d = dr * dr + dg * dg + db * db;
+        if (d < best_d) { best_d = d; best = p; }
+      }
+      indices |= static_cast<std::uint32_t>(best) << (2 * i);
+    }
+  }
+  out[0] = v0 & 0xff; out[1] = v0 >> 8;
+  out[2] = v1 & 0xff; out[3] = v1 >> 8;
+  for (int i = 0; i < 4; i++) out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// interpolated single channel block, as BC3 alpha and BC4/5
+inline void EncodeChannelBlock(const std::uint8_t values[16], std::uint8_t *out) {
+  int lo = 255, hi = 0;
+  for (int i = 0; i < 16; i++) {
+    lo = std::min<int>(lo, values[i]);
+    hi = std::max<int>(hi, values[i]);
+  }
+  std::uint64_t indices = 0;
+  if (hi > lo) {
+    // 8 value mode, r0 > r1: index 0 is hi, 1 is lo, 2-7 in between
+    for (int i = 0; i < 16; i++) {
+      int t = ((hi - values[i]) * 14 + (hi - lo)) / (2 * (hi - lo));  // 0..7 from hi to lo
+      int index = t == 0 ? 0 : (t == 7 ? 1 : t + 1);
+      indices |= static_cast<std::uint64_t>(index) << (3 * i);
+    }
+  }
+  out[0] = static_cast<std::uint8_t>(hi);
+  out[1] = static_cast<std::uint8_t>(lo);
+  for (int i = 0; i < 6; i++) out[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+inline void DecodeColorBlock(const std::uint8_t *in, bool allow_alpha, std::uint8_t texels[16][4]) {
+  std::uint16_t v0 = in[0] | in[1] << 8, v1 = in[2] | in[3] << 8;
+  int palette[4][4];
+  Unpack565(v0, palette[0]);
+  Unpack565(v1, palette[1]);
+  palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+  if (v0 > v1 || !allow_alpha) {
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+  } else {
+    for (int c = 0; c < 3; c++) {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+    palette[3][3] = 0;
+  }
+  std::uint32_t indices = in[4] | in[5] << 8 | in[6] << 16 | static_cast<std::uint32_t>(in[7]) << 24;
+  for (int i = 0; i < 16; i++) {
+    const int *p = palette[(indices >> (2 * i)) & 3];
+    for (int c = 0; c < 4; c++) texels[i][c] = static_cast<std::uint8_t>(p[c]);
+  }
+}
+
+inline void DecodeChannelBlock(const std::uint8_t *in, std::uint8_t values[16]) {
+  int r0 = in[0], r1 = in[1];
+  int palette[8] = {r0, r1};
+  if (r0 > r1) {
+    for (int k = 2; k < 8; k++) palette[k] = ((8 - k) * r0 + (k - 1) * r1) / 7;
+  } else {
+    for (int k = 2; k < 6; k++) palette[k] = ((6 - k) * r0 + (k - 1) * r1) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+  std::uint64_t indices = 0;
+  for (int i = 0; i < 6; i++) indices |= static_cast<std::uint64_t>(in[2 + i]) << (8 * i);
+  for (int i = 0; i < 16; i++) {
+    values[i] = static_cast<std::uint8_t>(palette[(indices >> (3 * i)) & 7]);
+  }
+}
+
+}  // namespace bc
+
+// Encodes RGBA8 texels (width x height, tightly packed) into blocks. The
+// texels past the edges repeat the last row/column.
+inline void EncodeBlocks(BlockFormat format, const std::uint8_t *rgba,
+                         int width, int height, std::uint8_t *out) {
+  for (int by = 0; by < height; by += 4) {
+    for (int bx = 0; bx < width; bx += 4) {
+      std::uint8_t texels[16][4];
+      for (int i = 0; i < 16; i++) {
+        int x = std::min(bx + (i & 3), width - 1);
+        int y = std::min(by + (i >> 2), height - 1);
+        std::memcpy(texels[i], rgba + (static_cast<std::size_t>(y) * width + x) * 4, 4);
+      }
+      std::uint8_t channel[16];
+      switch (format) {
+        case BlockFormat::kBC1:
+          bc::EncodeColorBlock(texels, out);
+          break;
+        case BlockFormat::kBC2:
+          for (int i = 0; i < 8; i++) {
+            out[i] = static_cast<std::uint8_t>((texels[2 * i][3] >> 4) | (texels[2 * i + 1][3] & 0xf0));
+          }
+          bc::EncodeColorBlock(texels, out + 8);
+          break;
+        case BlockFormat::kBC3:
+          for (int i = 0; i < 16; i++) channel[i] = texels[i][3];
+          bc::EncodeChannelBlock(channel, out);
+          bc::EncodeColorBlock(texels, out + 8);
+          break;
+        case BlockFormat::kBC4:
+          for (int i = 0; i < 16; i++) channel[i] = texels[i][0];
+          bc::EncodeChannelBlock(channel, out);
+          break;
+        case BlockFormat::kBC5:
+          for (int i = 0; i < 16; i++) channel[i] = texels[i][0];
+          bc::EncodeChannelBlock(channel, out);
+          for (int i = 0; i < 16; i++) channel[i] = texels[i][1];
+          bc::EncodeChannelBlock(channel, out + 8);
+          break;
+      }
+      out += BlockBytes(format);
+    }
+  }
+}
+
+// Decodes blocks into RGBA8 texels (width x height, tightly packed). BC4 is
+// decoded to (r, 0, 0, 255) and BC5 to (r, g, 0, 255) as GL samples them.
+inline void DecodeBlocks(BlockFormat format, const std::uint8_t *in,
+                         int width, int height, std::uint8_t *rgba) {
+  for (int by = 0; by < height; by += 4) {
+    for (int bx = 0; bx < width; bx += 4) {
+      std::uint8_t texels[16][4];
+      std::uint8_t channel[16];
+      switch (format) {
+        case BlockFormat::kBC1:
+          bc::DecodeColorBlock(in, true, texels);
+          break;
+        case BlockFormat::kBC2:
+          bc::DecodeColorBlock(in + 8, false, texels);
+          for (int i = 0; i < 16; i++) {
+            int a = (in[i / 2] >> (4 * (i & 1))) & 0xf;
+            texels[i][3] = static_cast<std::uint8_t>(a | a << 4);
+          }
+          break;
+        case BlockFormat::kBC3:
+          bc::DecodeColorBlock(in + 8, false, texels);
+          bc::DecodeChannelBlock(in, channel);
+          for (int i = 0; i < 16; i++) texels[i][3] = channel[i];
+          break;
+        case BlockFormat::kBC4:
+          bc::DecodeChannelBlock(in, channel);
+          for (int i = 0; i < 16; i++) {
+            texels[i][0] = channel[i];
+            texels[i][1] = texels[i][2] = 0;
+            texels[i][3] = 255;
+          }
+          break;
+        case BlockFormat::kBC5:
+          bc::DecodeChannelBlock(in, channel);
+          for (int i = 0; i < 16; i++) texels[i][0] = channel[i];
+          bc::DecodeChannelBlock(in + 8, channel);
+          for (int i = 0; i < 16; i++) {
+            texels[i][1] = channel[i];
+            texels[i][2] = 0;
+            texels[i][3] = 255;
+          }
+          break;
+      }
+      for (int i = 0; i < 16; i++) {
+        int x = bx + (i & 3), y = by + (i >> 2);
+        if (x < width && y < height) {
+          std::memcpy(rgba + (static_cast<std::size_t>(y) * width + x) * 4, texels[i], 4);
+        }
+      }
+      in += BlockBytes(format);
+    }
+  }
+}
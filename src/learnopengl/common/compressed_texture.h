@@ -0,0 +1,434 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "block_compression.h"
+#include "texture_cache.h"
+
+// Pre-compressed textures in KTX2 or DDS containers, with their mip chains.
+//
+// BC1-5, BC7 and ETC2 are uploaded as is by glCompressedTexImage2D. If the
+// driver lacks BC1-5, or TEXTURE_DECOMPRESS=1 is set, they are decoded on the
+// CPU and uploaded as RGBA8 instead, so software renderers show the same
+// pixels. Supercompressed (Basis) KTX2 files are not supported.
+
+struct CompressedImage {
+  struct Level {
+    int width, height;
+    std::size_t offset[6];  // per face, into data
+    std::size_t size;       // of one face
+  };
+
+  GLenum internal_format = 0;  // linear variant
+  bool srgb = false;           // stored as sRGB
+  bool decodable = false;      // block_format is set
+  BlockFormat block_format = BlockFormat::kBC1;
+  int faces = 1;
+  std::vector<Level> levels;
+  std::vector<std::uint8_t> data;
+
+  int width() const { return levels.empty() ? 0 : levels[0].width; }
+  int height() const { return levels.empty() ? 0 : levels[0].height; }
+};
+
+namespace compressed {
+
+// limits of what the headers may claim, a level count past 32 would shift a
+// 32-bit size out, and a side past 64k is beyond any GL
+constexpr std::uint32_t kMaxLevels = 32;
+constexpr std::uint32_t kMaxSize = 1 << 16;
+
+struct FormatInfo {
+  GLenum format;
+  GLenum srgb_format;  // 0 if none
+  bool decodable;
+  BlockFormat block_format;
+  int block_bytes;
+};
+
+// by VkFormat, as stored in KTX2
+inline bool FormatFromVk(std::uint32_t vk_format, FormatInfo *info, bool *srgb) {
+  switch (vk_format) {
+    case 131: case 132: *info = {GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, true, BlockFormat::kBC1, 8}; break;
+    case 133: case 134: *info = {GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, true, BlockFormat::kBC1, 8}; break;
+    case 135: case 136: *info = {GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, true, BlockFormat::kBC2, 16}; break;
+    case 137: case 138: *info = {GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, true, BlockFormat::kBC3, 16}; break;
+    case 139: *info = {GL_COMPRESSED_RED_RGTC1, 0, true, BlockFormat::kBC4, 8}; break;
+    case 141: *info = {GL_COMPRESSED_RG_RGTC2, 0, true, BlockFormat::kBC5, 16}; break;
+    case 145: case 146: *info = {GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, false, BlockFormat::kBC1, 16}; break;
+    case 147: case 148: *info = {GL_COMPRESSED_RGB8_ETC2, GL_COMPRESSED_SRGB8_ETC2, false, BlockFormat::kBC1, 8}; break;
+    case 149: case 150: *info = {GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2, GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2, false, BlockFormat::kBC1, 8}; break;
+    case 151: case 152: *info = {GL_COMPRESSED_RGBA8_ETC2_EAC, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, false, BlockFormat::kBC1, 16}; break;
+    default: return false;
+  }
+  // the sRGB variants are the even ones
+  *srgb = info->srgb_format != 0 && vk_format % 2 == 0;
+  return true;
+}
+
+// by DXGI_FORMAT, as stored in the DDS DX10 header
+inline bool FormatFromDxgi(std::uint32_t dxgi_format, FormatInfo *info, bool *srgb) {
+  switch (dxgi_format) {
+    case 71: return FormatFromVk(133, info, srgb);  // BC1_UNORM
+    case 72: return FormatFromVk(134, info, srgb);  // BC1_UNORM_SRGB
+    case 74: return FormatFromVk(135, info, srgb);  // BC2_UNORM
+    case 75: return FormatFromVk(136, info, srgb);  // BC2_UNORM_SRGB
+    case 77: return FormatFromVk(137, info, srgb);  // BC3_UNORM
+    case 78: return FormatFromVk(138, info, srgb);  // BC3_UNORM_SRGB
+    case 80: return FormatFromVk(139, info, srgb);  // BC4_UNORM
+    case 83: return FormatFromVk(141, info, srgb);  // BC5_UNORM
+    case 98: return FormatFromVk(145, info, srgb);  // BC7_UNORM
+    case 99: return FormatFromVk(146, info, srgb);  // BC7_UNORM_SRGB
+    default: return false;
+  }
+}
+
+inline std::uint32_t FourCC(const char s[4]) {
+  return static_cast<std::uint32_t>(s[0]) | static_cast<std::uint32_t>(s[1]) << 8 |
+      static_cast<std::uint32_t>(s[2]) << 16 | static_cast<std::uint32_t>(s[3]) << 24;
+}
+
+template <typename T>
+inline T Read(const std::vector<std::uint8_t> &file, std::size_t offset) {
+  T v;
+  std::memcpy(&v, file.data() + offset, sizeof(T));
+  return v;
+}
+
+inline void SetFormat(CompressedImage *image, const FormatInfo &info, bool srgb) {
+  image->internal_format = info.format;
+  image->srgb = srgb;
+  image->decodable = info.decodable;
+  image->block_format = info.block_format;
+}
+
+inline std::size_t LevelSize(const FormatInfo &info, int width, int height) {
+  return static_cast<std::size_t>((width + 3) / 4) * ((height + 3) / 4) * info.block_bytes;
+}
+
+inline bool ParseKtx2(std::vector<std::uint8_t> &&file, CompressedImage *image) {
+  static const std::uint8_t kIdentifier[12] = {
+      0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+  if (file.size() < 80 || std::memcmp(file.data(), kIdentifier, 12) != 0) return false;
+
+  auto vk_format = Read<std::uint32_t>(file, 12);
+  auto width = Read<std::uint32_t>(file, 20);
+  auto height = Read<std::uint32_t>(file, 24);
+  auto depth = Read<std::uint32_t>(file, 28);
+  auto layers = Read<std::uint32_t>(file, 32);
+  auto faces = Read<std::uint32_t>(file, 36);
+  auto level_count = std::max<std::uint32_t>(1, Read<std::uint32_t>(file, 40));
+  auto supercompression = Read<std::uint32_t>(file, 44);
+
+  FormatInfo info;
+  bool srgb;
+  if (!FormatFromVk(vk_format, &info, &srgb)) {
+    std::cout << "ERROR::KTX2_FORMAT: " << vk_format << std::endl;
+    return false;
+  }
+  if (supercompression != 0 || depth > 1 || layers > 1 || (faces != 1 && faces != 6) ||
+      width == 0 || width > kMaxSize || height > kMaxSize || level_count > kMaxLevels ||
+      file.size() < 80 + std::size_t(level_count) * 24) {
+    std::cout << "ERROR::KTX2_UNSUPPORTED" << std::endl;
+    return false;
+  }
+  SetFormat(image, info, srgb);
+  image->faces = faces;
+  for (std::uint32_t i = 0; i < level_count; i++) {
+    CompressedImage::Level level;
+    level.width = std::max<int>(1, width >> i);
+    level.height = std::max<int>(1, height >> i);
+    level.size = LevelSize(info, level.width, level.height);
+    auto offset = Read<std::uint64_t>(file, 80 + std::size_t(i) * 24);
+    auto length = Read<std::uint64_t>(file, 80 + std::size_t(i) * 24 + 8);
+    if (length < level.size * faces || offset > file.size() || length > file.size() - offset) return false;
+    for (std::uint32_t f = 0; f < faces; f++) level.offset[f] = offset + f * level.size;
+    image->levels.push_back(level);
+  }
+  image->data = std::move(file);
+  return true;
+}
+
+inline bool ParseDds(std::vector<std::uint8_t> &&file, CompressedImage *image) {
+  if (file.size() < 128 || Read<std::uint32_t>(file, 0) != FourCC("DDS ")) return false;
+
+  auto height = Read<std::uint32_t>(file, 12);
+  auto width = Read<std::uint32_t>(file, 16);
+  auto level_count = std::max<std::uint32_t>(1, Read<std::uint32_t>(file, 28));
+  auto fourcc = Read<std::uint32_t>(file, 84);
+  auto caps2 = Read<std::uint32_t>(file, 112);
+  int faces = (caps2 & 0x200) ? 6 : 1;  // DDSCAPS2_CUBEMAP
+  std::size_t offset = 128;
+
+  FormatInfo info;
+  bool srgb = false, ok = true;
+  if (fourcc == FourCC("DXT1")) {
+    ok = FormatFromVk(133, &info, &srgb);
+  } else if (fourcc == FourCC("DXT3")) {
+    ok = FormatFromVk(135, &info, &srgb);
+  } else if (fourcc == FourCC("DXT5")) {
+    ok = FormatFromVk(137, &info, &srgb);
+  } else if (fourcc == FourCC("ATI1") || fourcc == FourCC("BC4U")) {
+    ok = FormatFromVk(139, &info, &srgb);
+  } else if (fourcc == FourCC("ATI2") || fourcc == FourCC("BC5U")) {
+    ok = FormatFromVk(141, &info, &srgb);
+  } else if (fourcc == FourCC("DX10") && file.size() >= 148) {
+    ok = FormatFromDxgi(Read<std::uint32_t>(file, 128), &info, &srgb);
+    if (Read<std::uint32_t>(file, 136) & 0x4) faces = 6;  // DDS_RESOURCE_MISC_TEXTURECUBE
+    offset = 148;
+  } else {
+    ok = false;
+  }
+  if (!ok) {
+    std::cout << "ERROR::DDS_FORMAT: " << fourcc << std::endl;
+    return false;
+  }
+  if (width == 0 || width > kMaxSize || height > kMaxSize || level_count > kMaxLevels) {
+    std::cout << "ERROR::DDS_UNSUPPORTED" << std::endl;
+    return false;
+  }
+  SetFormat(image, info, srgb);
+  image->faces = faces;
+
+  // faces are stored one after another, each with all its levels
+  image->levels.resize(level_count);
+  for (int f = 0; f < faces; f++) {
+    for (std::uint32_t i = 0; i < level_count; i++) {
+      CompressedImage::Level &level = image->levels[i];
+      level.width = std::max<int>(1, width >> i);
+      level.height = std::max<int>(1, height >> i);
+      level.size = LevelSize(info, level.width, level.height);
+      if (offset > file.size() || level.size > file.size() - offset) return false;
+      level.offset[f] = offset;
+      offset += level.size;
+    }
+  }
+  image->data = std::move(file);
+  return true;
+}
+
+inline bool EndsWith(const std::string &s, const char *suffix) {
+  std::size_t n = std::strlen(suffix);
+  if (s.size() < n) return false;
+  for (std::size_t i = 0; i < n; i++) {
+    if (std::tolower(static_cast<unsigned char>(s[s.size() - n + i])) != suffix[i]) return false;
+  }
+  return true;
+}
+
+}  // namespace compressed
+
+inline bool IsCompressedTexturePath(const std::string &path) {
+  return compressed::EndsWith(path, ".ktx2") || compressed::EndsWith(path, ".dds");
+}
+
+// The compressed version of an image file, if TEXTURE_COMPRESSED=1 and
+// <name>.ktx2 or <name>.dds exists beside it, e.g. built by texture_convert.
+// Otherwise the path itself.
+inline std::string CompressedTexturePath(const std::string &path) {
+  const char *env = std::getenv("TEXTURE_COMPRESSED");
+  if (!env || std::string(env) != "1" || IsCompressedTexturePath(path)) return path;
+  auto dot = path.find_last_of('.');
+  auto slash = path.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path;
+  for (const char *ext : {".ktx2", ".dds"}) {
+    std::string candidate = path.substr(0, dot) + ext;
+    if (std::ifstream(candidate).good()) return candidate;
+  }
+  return path;
+}
+
+// whether the format stores alpha, as a 4 component image
+inline bool CompressedHasAlpha(GLenum format) {
+  return format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+      format == GL_COMPRESSED_RGBA_BPTC_UNORM || format == GL_COMPRESSED_RGBA8_ETC2_EAC ||
+      format == GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+}
+
+inline bool LoadCompressedImage(const std::string &path, CompressedImage *image) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) return false;
+  std::vector<std::uint8_t> file(static_cast<std::size_t>(in.tellg()));
+  in.seekg(0);
+  if (!in.read(reinterpret_cast<char *>(file.data()), file.size())) return false;
+
+  if (compressed::EndsWith(path, ".dds")) return compressed::ParseDds(std::move(file), image);
+  return compressed::ParseKtx2(std::move(file), image);
+}
+
+// whether the driver could sample the format, else it's decoded on the CPU
+inline bool IsCompressedFormatSupported(GLenum format) {
+  static const bool force_decompress = [] {
+    const char *env = std::getenv("TEXTURE_DECOMPRESS");
+    return env && std::string(env) == "1";
+  }();
+  if (force_decompress) return false;
+  switch (format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+      return GLEW_EXT_texture_compression_s3tc;
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_RG_RGTC2:
+      return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+      return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+    default:  // ETC2
+      return GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility;
+  }
+}
+
+// Uploads all levels to the bound texture of target, GL_TEXTURE_2D or
+// GL_TEXTURE_CUBE_MAP (six faces, or one face at face_target).
+inline bool UploadCompressedImage(GLenum target, const CompressedImage &image,
+                                  const TextureParams &params, GLenum face_target = 0) {
+  compressed::FormatInfo info;
+  bool srgb = image.srgb || params.srgb;
+  GLenum format = image.internal_format;
+  if (srgb) {
+    // the linear and sRGB variants map by the same VkFormat table
+    for (std::uint32_t vk = 131; vk <= 152; vk++) {
+      bool s;
+      if (compressed::FormatFromVk(vk, &info, &s) && info.format == format && info.srgb_format) {
+        format = info.srgb_format;
+        break;
+      }
+    }
+  }
+
+  bool supported = IsCompressedFormatSupported(image.internal_format);
+  if (srgb && format == image.internal_format) {
+    supported = false;  // no sRGB variant, as BC4/5
+  } else if (srgb && image.decodable) {
+    supported = supported && GLEW_EXT_texture_sRGB;  // for the S3TC sRGB formats
+  }
+  if (!supported && !image.decodable) {
+    std::cout << "ERROR::COMPRESSED_FORMAT_UNSUPPORTED: " << image.internal_format << std::endl;
+    return false;
+  }
+
+  std::vector<std::uint8_t> rgba;
+  GLint last_alignment = 4;
+  if (!supported) {
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &last_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  }
+  for (std::size_t i = 0; i < image.levels.size(); i++) {
+    const CompressedImage::Level &level = image.levels[i];
+    for (int f = 0; f < image.faces; f++) {
+      GLenum t = target == GL_TEXTURE_CUBE_MAP
+          ? (image.faces == 6 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + f : face_target)
+          : target;
+      const std::uint8_t *blocks = image.data.data() + level.offset[f];
+      if (supported) {
+        glCompressedTexImage2D(t, i, format, level.width, level.height, 0, level.size, blocks);
+      } else {
+        rgba.resize(static_cast<std::size_t>(level.width) * level.height * 4);
+        DecodeBlocks(image.block_format, blocks, level.width, level.height, rgba.data());
+        glTexImage2D(t, i, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, level.width, level.height, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+      }
+    }
+  }
+  if (!supported) glPixelStorei(GL_UNPACK_ALIGNMENT, last_alignment);
+
+  // no glGenerateMipmap, a partial chain is clamped instead
+  GLenum param_target = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+  glTexParameteri(param_target, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(param_target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levels.size()) - 1);
+  return true;
+}
+
+// Writes a KTX2 file of one or six faces, levels[i][f] holding the blocks of
+// level i and face f. vk_format is a BC1-5 VkFormat.
+inline bool WriteKtx2(const std::string &path, std::uint32_t vk_format, int width, int height,
+                      const std::vector<std::vector<std::vector<std::uint8_t>>> &levels) {
+  compressed::FormatInfo info;
+  bool srgb;
+  if (!compressed::FormatFromVk(vk_format, &info, &srgb) || levels.empty()) return false;
+  const std::uint32_t faces = levels[0].size();
+  const std::uint32_t level_count = levels.size();
+
+  // data format descriptor, a basic block with one sample per plane
+  std::vector<std::uint32_t> dfd;
+  {
+    int samples = (info.block_format == BlockFormat::kBC1 || info.block_format == BlockFormat::kBC4) ? 1 : 2;
+    std::uint32_t model = 128 + static_cast<int>(info.block_format);  // KHR_DF_MODEL_BC1A..BC5
+    std::uint32_t block_size = 24 + 16 * samples;
+    dfd.push_back(4 + block_size);
+    dfd.push_back(0);                                      // vendor, type
+    dfd.push_back(2 | block_size << 16);                   // version 2
+    dfd.push_back(model | 1 << 8 | (srgb ? 2 : 1) << 16);  // BT709 primaries, transfer
+    dfd.push_back(3 | 3 << 8);                             // 4x4 texel blocks
+    dfd.push_back(info.block_bytes);                       // bytes in plane 0
+    dfd.push_back(0);
+    for (int s = 0; s < samples; s++) {
+      // BC2/BC3 store alpha (channel 15) then color, BC5 red then green (channel 1)
+      std::uint32_t channel = s == 0 ? (samples == 2 && info.block_format != BlockFormat::kBC5 ? 15 : 0) : (info.block_format == BlockFormat::kBC5 ? 1 : 0);
+      dfd.push_back((s * 64) | 63 << 16 | channel << 24);
+      dfd.push_back(0);
+      dfd.push_back(0);
+      dfd.push_back(0xFFFFFFFFu);
+    }
+  }
+
+  const std::size_t index_end = 80 + level_count * 24;
+  const std::size_t dfd_offset = index_end;
+  const std::size_t dfd_length = dfd.size() * 4;
+  std::size_t offset = dfd_offset + dfd_length;
+
+  // levels are stored from the smallest, each aligned to the block size
+  std::vector<std::uint64_t> level_offset(level_count), level_length(level_count);
+  for (std::uint32_t i = level_count; i-- > 0;) {
+    offset = (offset + 15) & ~std::size_t(15);
+    level_offset[i] = offset;
+    level_length[i] = 0;
+    for (auto &&face : levels[i]) level_length[i] += face.size();
+    offset += level_length[i];
+  }
+
+  std::vector<std::uint8_t> file(offset, 0);
+  auto put32 = [&file](std::size_t at, std::uint32_t v) { std::memcpy(&file[at], &v, 4); };
+  auto put64 = [&file](std::size_t at, std::uint64_t v) { std::memcpy(&file[at], &v, 8); };
+  static const std::uint8_t kIdentifier[12] = {
+      0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+  std::memcpy(file.data(), kIdentifier, 12);
+  put32(12, vk_format);
+  put32(16, 1);  // typeSize
+  put32(20, width);
+  put32(24, height);
+  put32(28, 0);
+  put32(32, 0);
+  put32(36, faces);
+  put32(40, level_count);
+  put32(44, 0);  // no supercompression
+  put32(48, dfd_offset);
+  put32(52, dfd_length);
+  for (std::uint32_t i = 0; i < level_count; i++) {
+    put64(80 + i * 24, level_offset[i]);
+    put64(80 + i * 24 + 8, level_length[i]);
+    put64(80 + i * 24 + 16, level_length[i]);
+  }
+  std::memcpy(&file[dfd_offset], dfd.data(), dfd_length);
+  for (std::uint32_t i = 0; i < level_count; i++) {
+    std::size_t at = level_offset[i];
+    for (auto &&face : levels[i]) {
+      std::memcpy(&file[at], face.data(), face.size());
+      at += face.size();
+    }
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(file.data()), file.size());
+  return static_cast<bool>(out);
+}
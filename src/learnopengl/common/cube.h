@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
@@ -9,6 +10,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "base/render_queue.h"
+
 #include "shader.h"
 #include "stb_image_impl.h"
 
@@ -41,20 +44,11 @@ class Cube {
   }
 
   void DrawTen(const glm::mat4 &projection, const glm::mat4 &view) {
-    // world space positions of our cubes
-    static std::vector<glm::vec3> cubePositions{
-      glm::vec3( 0.0f,  0.0f,  0.0f),
-      glm::vec3( 2.0f,  5.0f, -15.0f),
-      glm::vec3(-1.5f, -2.2f, -2.5f),
-      glm::vec3(-3.8f, -2.0f, -12.3f),
-      glm::vec3( 2.4f, -0.4f, -3.5f),
-      glm::vec3(-1.7f,  3.0f, -7.5f),
-      glm::vec3( 1.3f, -2.0f, -2.5f),
-      glm::vec3( 1.5f,  2.0f, -2.5f),
-      glm::vec3( 1.5f,  0.2f, -1.5f),
-      glm::vec3(-1.3f,  1.0f, -1.5f),
-    };
-    Draw(projection, view, cubePositions);
+    Draw(projection, view, TenPositions());
+  }
+
+  void DrawTen(RenderQueue *queue, const glm::mat4 &projection, const glm::mat4 &view) {
+    Draw(queue, projection, view, TenPositions());
   }
 
   void Draw(const glm::mat4 &projection, const glm::mat4 &view, std::vector<glm::vec3> positions) {
@@ -76,22 +70,62 @@ class Cube {
     glBindVertexArray(VAO);
     for (std::size_t i = 0, n = positions.size(); i < n; i++) {
       // calculate the model matrix for each object and pass it to shader before drawing
-      glm::mat4 model = glm::mat4(1.0f);  // make sure to initialize matrix to identity matrix first
-      model = glm::translate(model, positions[i]);
-      float angle = 20.0f * i;
-      model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-      Shader->SetMat4("model", model);
+      Shader->SetMat4("model", ModelMatrix(positions[i], i));
 
       glDrawArrays(GL_TRIANGLES, 0, 36);
     }
   }
 
+  // records the cubes into the queue instead, front to back, see RenderQueue
+  void Draw(RenderQueue *queue, const glm::mat4 &projection, const glm::mat4 &view,
+            const std::vector<glm::vec3> &positions, std::uint32_t pass = 0) {
+    const GLint projection_location = Shader->GetUniformLocation("projection");
+    const GLint view_location = Shader->GetUniformLocation("view");
+    const GLint model_location = Shader->GetUniformLocation("model");
+    for (std::size_t i = 0, n = positions.size(); i < n; i++) {
+      glm::mat4 model = ModelMatrix(positions[i], i);
+      float depth = -(view * model[3]).z;
+      queue->Begin(RenderQueue::MakeKey(pass, false, Shader->ID, Texture1, VAO, depth), Shader->ID, VAO, Texture1);
+      // the same for all, the queue sets them once
+      queue->SetMat4(projection_location, projection);
+      queue->SetMat4(view_location, view);
+      queue->SetMat4(model_location, model);
+      queue->BindTexture({0, GL_TEXTURE_2D, Texture1, -1});
+      queue->BindTexture({1, GL_TEXTURE_2D, Texture2, -1});
+      queue->DrawArrays(GL_TRIANGLES, 0, 36);
+    }
+  }
+
   void Destory() {
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
   }
 
  private:
+  // world space positions of our cubes
+  static const std::vector<glm::vec3> &TenPositions() {
+    static const std::vector<glm::vec3> cubePositions{
+      glm::vec3( 0.0f,  0.0f,  0.0f),
+      glm::vec3( 2.0f,  5.0f, -15.0f),
+      glm::vec3(-1.5f, -2.2f, -2.5f),
+      glm::vec3(-3.8f, -2.0f, -12.3f),
+      glm::vec3( 2.4f, -0.4f, -3.5f),
+      glm::vec3(-1.7f,  3.0f, -7.5f),
+      glm::vec3( 1.3f, -2.0f, -2.5f),
+      glm::vec3( 1.5f,  2.0f, -2.5f),
+      glm::vec3( 1.5f,  0.2f, -1.5f),
+      glm::vec3(-1.3f,  1.0f, -1.5f),
+    };
+    return cubePositions;
+  }
+
+  static glm::mat4 ModelMatrix(const glm::vec3 &position, std::size_t i) {
+    glm::mat4 model = glm::mat4(1.0f);  // make sure to initialize matrix to identity matrix first
+    model = glm::translate(model, position);
+    float angle = 20.0f * i;
+    return glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+  }
+
   void CreateShader() {
     // Shader sources
     const char *vertexShaderSource = R"glsl(
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "shader.h"
+#include "vertex_pool.h"
+
+// layout of GL_DRAW_INDIRECT_BUFFER commands
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+// Draws many meshes of the VertexPool at once, one glMultiDrawElementsIndirect
+// per pool chunk with a command per draw. With GL 4.3, or ARB_multi_draw_indirect
+// and base instances (GL 4.2 or ARB_base_instance) that carry the draw id, that
+// is, else it loops glDrawElementsBaseVertex.
+//
+// A draw finds its data by the draw id, an instanced attribute at location
+// kDrawIdLocation that the base instance of its command selects (or that
+// glVertexAttribI4ui sets in the loop). The data is kTexelsPerDraw RGBA32F
+// texels of the draw_data samplerBuffer: the columns of the transform (with
+// the position_dequant of a packed mesh folded in), then the texture layers
+// of the mesh, e.g.
+//   layout (location = 7) in uint aDrawId;
+//   uniform samplerBuffer draw_data;
+//   int texel = int(aDrawId) * 5;
+//   mat4 model = mat4(texelFetch(draw_data, texel), texelFetch(draw_data, texel + 1),
+//                     texelFetch(draw_data, texel + 2), texelFetch(draw_data, texel + 3));
+//   ivec4 layers = ivec4(texelFetch(draw_data, texel + 4));
+//
+// The buffers are uploaded on the first Draw() after a change, so a static
+// scene is added once. Must be used on the GL thread.
+class DrawBatch {
+ public:
+  static constexpr GLuint kDrawIdLocation = 7;
+  static constexpr int kTexelsPerDraw = 5;
+
+  DrawBatch()
+    : indirect_(GLEW_VERSION_4_3 ||
+                (GLEW_ARB_multi_draw_indirect && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance))) {}
+
+  DrawBatch(const DrawBatch &) = delete;
+  DrawBatch &operator=(const DrawBatch &) = delete;
+
+  ~DrawBatch() {
+    for (auto &&group : groups_) {
+      if (group.vao) glDeleteVertexArrays(1, &group.vao);
+    }
+    GLuint buffers[] = {command_buffer_, draw_id_buffer_, data_buffer_};
+    glDeleteBuffers(3, buffers);
+    if (data_texture_) glDeleteTextures(1, &data_texture_);
+  }
+
+  void Clear() {
+    for (auto &&group : groups_) group.commands.clear();
+    data_.clear();
+    draw_count_ = 0;
+    dirty_ = true;
+  }
+
+  // adds a draw of the mesh with the transform, returns its draw id
+  GLuint Add(const Mesh &mesh, const glm::mat4 &transform) {
+    const VertexPool::Allocation &a = mesh.allocation();
+    Group *group = nullptr;
+    for (auto &&g : groups_) {
+      if (g.pool_vao == a.vao) group = &g;
+    }
+    if (group == nullptr) {
+      groups_.push_back(Group());
+      group = &groups_.back();
+      group->pool_vao = a.vao;
+      if (indirect_) group->vao = mesh.CreateVertexArray();
+    }
+    GLuint id = draw_count_++;
+    const MeshLod lod = mesh.Lod(0);
+    group->commands.push_back({lod.index_count, 1, a.first_index + lod.first_index, a.base_vertex, id});
+
+    const float layers[4] = {
+      static_cast<float>(mesh.texture_layers.x), static_cast<float>(mesh.texture_layers.y),
+      static_cast<float>(mesh.texture_layers.z), static_cast<float>(mesh.texture_layers.w),
+    };
+    std::size_t texel = data_.size();
+    data_.resize(texel + kTexelsPerDraw * 4);
+    const glm::mat4 model = transform * mesh.position_dequant;
+    std::memcpy(&data_[texel], &model[0][0], 16 * sizeof(float));
+    std::memcpy(&data_[texel + 16], layers, sizeof(layers));
+    dirty_ = true;
+    return id;
+  }
+
+  // draws everything added with the shader in use, the draw_data sampler on data_unit
+  void Draw(const Shader &shader, GLint data_unit = 8) {
+    if (draw_count_ == 0) return;
+    if (dirty_) Upload();
+
+    glActiveTexture(GL_TEXTURE0 + data_unit);
+    glBindTexture(GL_TEXTURE_BUFFER, data_texture_);
+    glActiveTexture(GL_TEXTURE0);
+    shader.SetInt(UNIFORM_ID("draw_data"), data_unit);
+
+    const bool base_vertex = VertexPool::ForFormat(MeshVertexFormat()).has_base_vertex();
+    if (indirect_) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+    std::size_t offset = 0;
+    for (auto &&group : groups_) {
+      if (group.commands.empty()) continue;
+      if (indirect_) {
+        glBindVertexArray(group.vao);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+            reinterpret_cast<const void *>(offset * sizeof(DrawElementsIndirectCommand)),
+            static_cast<GLsizei>(group.commands.size()), 0);
+      } else {
+        // the shared VAO has no array at the location, so the current value is read
+        glBindVertexArray(group.pool_vao);
+        for (auto &&c : group.commands) {
+          glVertexAttribI4ui(kDrawIdLocation, c.base_instance, 0, 0, 0);
+          const void *indices = reinterpret_cast<const void *>(c.first_index * sizeof(GLuint));
+          if (base_vertex) {
+            glDrawElementsBaseVertex(GL_TRIANGLES, c.count, GL_UNSIGNED_INT, indices, c.base_vertex);
+          } else {
+            glDrawElements(GL_TRIANGLES, c.count, GL_UNSIGNED_INT, indices);
+          }
+        }
+      }
+      offset += group.commands.size();
+    }
+    glBindVertexArray(0);
+    if (indirect_) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+
+  // number of draws added
+  std::size_t size() const { return draw_count_; }
+  // GL calls a Draw() makes to draw them, the groups if indirect
+  std::size_t draw_calls() const {
+    std::size_t calls = 0;
+    for (auto &&group : groups_) {
+      if (!group.commands.empty()) calls += indirect_ ? 1 : group.commands.size();
+    }
+    return calls;
+  }
+  bool indirect() const { return indirect_; }
+
+ private:
+  // draws of one VertexPool chunk
+  struct Group {
+    GLuint pool_vao = 0;
+    GLuint vao = 0;  // over the chunk, with the draw id array
+    std::vector<DrawElementsIndirectCommand> commands;
+  };
+
+  void Upload() {
+    if (data_buffer_ == 0) {
+      glGenBuffers(1, &data_buffer_);
+      glGenTextures(1, &data_texture_);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, data_buffer_);
+    glBufferData(GL_TEXTURE_BUFFER, data_.size() * sizeof(float), data_.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, data_texture_);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, data_buffer_);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    if (indirect_) {
+      std::vector<DrawElementsIndirectCommand> commands;
+      commands.reserve(draw_count_);
+      for (auto &&group : groups_) commands.insert(commands.end(), group.commands.begin(), group.commands.end());
+      if (command_buffer_ == 0) glGenBuffers(1, &command_buffer_);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+      glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+                   commands.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+      // draw ids 0..n-1, the base instance of a command picks its own
+      if (draw_id_capacity_ < draw_count_) {
+        std::vector<GLuint> ids(draw_count_);
+        for (GLuint i = 0; i < draw_count_; i++) ids[i] = i;
+        if (draw_id_buffer_ == 0) glGenBuffers(1, &draw_id_buffer_);
+        glBindBuffer(GL_ARRAY_BUFFER, draw_id_buffer_);
+        glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+        draw_id_capacity_ = draw_count_;
+      }
+      glBindBuffer(GL_ARRAY_BUFFER, draw_id_buffer_);
+      for (auto &&group : groups_) {
+        glBindVertexArray(group.vao);
+        glEnableVertexAttribArray(kDrawIdLocation);
+        glVertexAttribIPointer(kDrawIdLocation, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+        glVertexAttribDivisor(kDrawIdLocation, 1);
+      }
+      glBindVertexArray(0);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    dirty_ = false;
+  }
+
+  bool indirect_;
+  std::vector<Group> groups_;
+  std::vector<float> data_;
+  GLuint draw_count_ = 0;
+  bool dirty_ = true;
+
+  GLuint command_buffer_ = 0;
+  GLuint draw_id_buffer_ = 0;
+  GLuint draw_id_capacity_ = 0;
+  GLuint data_buffer_ = 0;
+  GLuint data_texture_ = 0;
+};
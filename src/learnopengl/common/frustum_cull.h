@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULL_SSE2 1
+#endif
+
+// planes of a view frustum, xyz the inward normal and w the distance, so a
+// point p is inside when dot(xyz, p) + w >= 0 for all of them
+struct Frustum {
+  glm::vec4 planes[6];
+
+  // of a projection * view matrix, the planes are in world space
+  // (Gribb and Hartmann), normalized so they give distances
+  static Frustum FromMatrix(const glm::mat4 &m) {
+    auto row = [&m](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+    const glm::vec4 r0 = row(0), r1 = row(1), r2 = row(2), r3 = row(3);
+    Frustum f;
+    f.planes[0] = r3 + r0;  // left
+    f.planes[1] = r3 - r0;  // right
+    f.planes[2] = r3 + r1;  // bottom
+    f.planes[3] = r3 - r1;  // top
+    f.planes[4] = r3 + r2;  // near
+    f.planes[5] = r3 - r2;  // far
+    for (auto &&p : f.planes) {
+      float length = std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+      if (length > 0.0f) p = p * (1.0f / length);
+    }
+    return f;
+  }
+};
+
+// bounding sphere enclosing both, xyz the center and w the radius
+inline glm::vec4 MergeSpheres(const glm::vec4 &a, const glm::vec4 &b) {
+  glm::vec3 ca(a), cb(b);
+  float d = glm::length(cb - ca);
+  if (d + b.w <= a.w) return a;
+  if (d + a.w <= b.w) return b;
+  float radius = (d + a.w + b.w) * 0.5f;
+  glm::vec3 center = ca + (cb - ca) * ((radius - a.w) / d);
+  return glm::vec4(center, radius);
+}
+
+// Bounding spheres as structure of arrays, the layout the SIMD test reads.
+// Padded to a multiple of 8 with spheres that are never visible.
+class SphereSoA {
+ public:
+  void Clear() {
+    x_.clear();
+    y_.clear();
+    z_.clear();
+    r_.clear();
+    size_ = 0;
+  }
+
+  void Add(const glm::vec3 &center, float radius) {
+    x_.resize(size_);
+    y_.resize(size_);
+    z_.resize(size_);
+    r_.resize(size_);
+    x_.push_back(center.x);
+    y_.push_back(center.y);
+    z_.push_back(center.z);
+    r_.push_back(radius);
+    size_++;
+    // empty at infinity
+    std::size_t padded = (size_ + 7) & ~std::size_t(7);
+    x_.resize(padded, INFINITY);
+    y_.resize(padded, INFINITY);
+    z_.resize(padded, INFINITY);
+    r_.resize(padded, -1.0f);
+  }
+
+  std::size_t size() const { return size_; }
+  const float *x() const { return x_.data(); }
+  const float *y() const { return y_.data(); }
+  const float *z() const { return z_.data(); }
+  const float *r() const { return r_.data(); }
+
+ private:
+  std::vector<float> x_, y_, z_, r_;
+  std::size_t size_ = 0;
+};
+
+namespace frustum_cull {
+
+// appends the set bits of the mask, sphere first + k for bit k, without branches
+inline std::size_t Compact(unsigned int mask, std::uint32_t first, std::uint32_t *visible, std::size_t count) {
+  for (std::uint32_t k = 0; k < 8; k++) {
+    visible[count] = first + k;
+    count += (mask >> k) & 1;
+  }
+  return count;
+}
+
+}  // namespace frustum_cull
+
+// Tests the spheres against the frustum, 8 per iteration with AVX or two
+// SSE2 halves. Writes the indices of the ones at least partly inside to
+// visible, which needs room for spheres.size() + 8, and returns their count.
+inline std::size_t CullSpheres(const Frustum &frustum, const SphereSoA &spheres, std::uint32_t *visible) {
+  std::size_t count = 0;
+  const std::size_t n = (spheres.size() + 7) & ~std::size_t(7);
+#if defined(__AVX__)
+  __m256 px[6], py[6], pz[6], pw[6];
+  for (int p = 0; p < 6; p++) {
+    px[p] = _mm256_set1_ps(frustum.planes[p].x);
+    py[p] = _mm256_set1_ps(frustum.planes[p].y);
+    pz[p] = _mm256_set1_ps(frustum.planes[p].z);
+    pw[p] = _mm256_set1_ps(frustum.planes[p].w);
+  }
+  const __m256 zero = _mm256_setzero_ps();
+  for (std::size_t i = 0; i < n; i += 8) {
+    __m256 x = _mm256_loadu_ps(spheres.x() + i), y = _mm256_loadu_ps(spheres.y() + i);
+    __m256 z = _mm256_loadu_ps(spheres.z() + i), r = _mm256_loadu_ps(spheres.r() + i);
+    __m256 inside = _mm256_cmp_ps(r, zero, _CMP_GE_OQ);
+    for (int p = 0; p < 6; p++) {
+      // distance + radius >= 0 for every plane
+      __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)),
+                               _mm256_add_ps(_mm256_mul_ps(pz[p], z), _mm256_add_ps(pw[p], r)));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+    }
+    count = frustum_cull::Compact(static_cast<unsigned int>(_mm256_movemask_ps(inside)),
+                                  static_cast<std::uint32_t>(i), visible, count);
+  }
+#elif defined(FRUSTUM_CULL_SSE2)
+  __m128 px[6], py[6], pz[6], pw[6];
+  for (int p = 0; p < 6; p++) {
+    px[p] = _mm_set1_ps(frustum.planes[p].x);
+    py[p] = _mm_set1_ps(frustum.planes[p].y);
+    pz[p] = _mm_set1_ps(frustum.planes[p].z);
+    pw[p] = _mm_set1_ps(frustum.planes[p].w);
+  }
+  const __m128 zero = _mm_setzero_ps();
+  for (std::size_t i = 0; i < n; i += 8) {
+    unsigned int mask = 0;
+    for (std::size_t h = 0; h < 8; h += 4) {
+      __m128 x = _mm_loadu_ps(spheres.x() + i + h), y = _mm_loadu_ps(spheres.y() + i + h);
+      __m128 z = _mm_loadu_ps(spheres.z() + i + h), r = _mm_loadu_ps(spheres.r() + i + h);
+      __m128 inside = _mm_cmpge_ps(r, zero);
+      for (int p = 0; p < 6; p++) {
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+                              _mm_add_ps(_mm_mul_ps(pz[p], z), _mm_add_ps(pw[p], r)));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+      }
+      mask |= static_cast<unsigned int>(_mm_movemask_ps(inside)) << h;
+    }
+    count = frustum_cull::Compact(mask, static_cast<std::uint32_t>(i), visible, count);
+  }
+#else
+  for (std::size_t i = 0; i < n; i += 8) {
+    unsigned int mask = 0;
+    for (std::size_t k = 0; k < 8; k++) {
+      const float x = spheres.x()[i + k], y = spheres.y()[i + k];
+      const float z = spheres.z()[i + k], r = spheres.r()[i + k];
+      bool inside = r >= 0.0f;
+      for (int p = 0; p < 6 && inside; p++) {
+        const glm::vec4 &plane = frustum.planes[p];
+        inside = plane.x * x + plane.y * y + plane.z * z + plane.w + r >= 0.0f;
+      }
+      mask |= static_cast<unsigned int>(inside) << k;
+    }
+    count = frustum_cull::Compact(mask, static_cast<std::uint32_t>(i), visible, count);
+  }
+#endif
+  return count;
+}
@@ -0,0 +1,442 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "draw_batch.h"
+#include "frustum_cull.h"
+#include "mesh.h"
+#include "shader.h"
+
+// Frustum culls instances on the GPU: a compute pass tests the bounding
+// sphere under each instance matrix, appends the visible matrices to
+// visible_buffer() and counts them into the instance_count of the indirect
+// commands, so the draws need no readback. Point the instanced attributes
+// at visible_buffer() and draw each mesh with Draw(), e.g.
+//   cull.Submit(&shader_batch);
+//   ...
+//   cull.Setup(instance_buffer, instance_count, bounds);
+//   for (auto &&mesh : meshes) cull.AddDraw(mesh);
+//   ...
+//   cull.Cull(projection * view);
+//   glBindVertexArray(vao_over_visible_buffer);
+//   cull.Draw(0);
+//
+// Submitted with occlusion, it also tests the instances against a Hi-Z
+// pyramid, the max depth mip chain of the previous frame. UpdateHiZ() at
+// the end of each frame copies the depth buffer and reduces it, then the
+// next Cull() projects the bounding box of each instance by the previous
+// frame's matrices, and drops it if it lies behind the depth at the mip
+// level where the box spans at most 2x2 texels. Moving the camera, an
+// instance that comes out from behind an occluder may show a frame late.
+// If the depth buffer can't be copied, it culls against the frustum only.
+//
+// Needs GL 4.3, see IsSupported().
+// Must be used on the GL thread.
+class GpuInstanceCull {
+ public:
+  static constexpr GLuint kLocalSize = 64;
+
+  GpuInstanceCull() = default;
+  GpuInstanceCull(const GpuInstanceCull &) = delete;
+  GpuInstanceCull &operator=(const GpuInstanceCull &) = delete;
+
+  ~GpuInstanceCull() {
+    GLuint buffers[] = {visible_buffer_, command_buffer_, stats_buffer_};
+    glDeleteBuffers(3, buffers);
+    GLuint textures[] = {depth_texture_, hiz_texture_};
+    glDeleteTextures(2, textures);
+    if (depth_framebuffer_) glDeleteFramebuffers(1, &depth_framebuffer_);
+  }
+
+  // GL 4.3 has the indirect draws too
+  static bool IsSupported() { return Shader::IsComputeSupported(); }
+
+  // adds the compute programs to the batch, before Setup(), occlusion for the Hi-Z test
+  void Submit(ShaderBatch *batch, bool occlusion = false) {
+    occlusion_ = occlusion;
+    if (occlusion_) {
+      batch->AddCompute(&reduce_program_, R"cs(
+        #version 430 core
+        layout (local_size_x = 8, local_size_y = 8) in;
+
+        layout (r32f, binding = 0) uniform writeonly image2D destination;
+        uniform sampler2D source;
+        uniform int source_level;
+
+        // max of the source texels under the destination one, 3 wide at odd edges
+        void main() {
+          ivec2 size = imageSize(destination);
+          ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+          if (any(greaterThanEqual(p, size))) return;
+          ivec2 source_size = textureSize(source, source_level);
+          ivec2 first = (p * source_size) / size;
+          ivec2 last = min(((p + 1) * source_size + size - 1) / size, source_size) - 1;
+          float depth = 0.0;
+          for (int y = first.y; y <= last.y; y++) {
+            for (int x = first.x; x <= last.x; x++) {
+              depth = max(depth, texelFetch(source, ivec2(x, y), source_level).r);
+            }
+          }
+          imageStore(destination, p, vec4(depth));
+        }
+      )cs");
+    }
+    batch->AddCompute(&program_, R"cs(
+      #version 430 core
+      layout (local_size_x = 64) in;
+
+      struct DrawElementsIndirectCommand {
+        uint count;
+        uint instanceCount;
+        uint firstIndex;
+        int baseVertex;
+        uint baseInstance;
+      };
+
+      layout (std430, binding = 0) readonly buffer Instances { mat4 instances[]; };
+      layout (std430, binding = 1) writeonly buffer Visible { mat4 visible[]; };
+      layout (std430, binding = 2) buffer Commands { DrawElementsIndirectCommand commands[]; };
+      layout (std430, binding = 3) buffer Stats { uint occluded; };
+
+      uniform vec4 planes[6];
+      uniform vec4 bounds;
+      uniform int instance_count;
+      uniform int command_count;
+
+      uniform int hiz_enabled;
+      uniform sampler2D hiz;
+      uniform mat4 hiz_projection_view;
+
+      // the world box of the sphere, behind the Hi-Z depth of the previous frame
+      bool IsOccluded(vec3 center, float radius) {
+        vec3 ndc_min = vec3(1e30), ndc_max = vec3(-1e30);
+        for (int c = 0; c < 8; c++) {
+          vec3 corner = center + radius * vec3((c & 1) != 0 ? 1.0 : -1.0, (c & 2) != 0 ? 1.0 : -1.0,
+                                               (c & 4) != 0 ? 1.0 : -1.0);
+          vec4 clip = hiz_projection_view * vec4(corner, 1.0);
+          // reaches behind the eye
+          if (clip.w <= 0.0) return false;
+          ndc_min = min(ndc_min, clip.xyz / clip.w);
+          ndc_max = max(ndc_max, clip.xyz / clip.w);
+        }
+        // partly off the previous frame, its depth is unknown there
+        if (any(lessThan(ndc_min.xy, vec2(-1.0))) || any(greaterThan(ndc_max.xy, vec2(1.0)))) return false;
+
+        vec2 uv_min = ndc_min.xy * 0.5 + 0.5;
+        vec2 uv_max = ndc_max.xy * 0.5 + 0.5;
+        float nearest = ndc_min.z * 0.5 + 0.5;
+        // the level where the box is at most a texel wide, so 2x2 texels cover it
+        vec2 extent = (uv_max - uv_min) * vec2(textureSize(hiz, 0));
+        int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, textureQueryLevels(hiz) - 1);
+        ivec2 size = textureSize(hiz, level);
+        ivec2 lo = clamp(ivec2(uv_min * vec2(size)), ivec2(0), size - 1);
+        ivec2 hi = clamp(ivec2(uv_max * vec2(size)), ivec2(0), size - 1);
+        float depth = max(max(texelFetch(hiz, lo, level).r, texelFetch(hiz, ivec2(hi.x, lo.y), level).r),
+                          max(texelFetch(hiz, ivec2(lo.x, hi.y), level).r, texelFetch(hiz, hi, level).r));
+        return nearest > depth;
+      }
+
+      void main() {
+        int i = int(gl_GlobalInvocationID.x);
+        if (i >= instance_count) return;
+        mat4 m = instances[i];
+        vec3 center = (m * vec4(bounds.xyz, 1.0)).xyz;
+        float scale = max(dot(m[0].xyz, m[0].xyz), max(dot(m[1].xyz, m[1].xyz), dot(m[2].xyz, m[2].xyz)));
+        float radius = bounds.w * sqrt(scale);
+        for (int p = 0; p < 6; p++) {
+          if (dot(planes[p].xyz, center) + planes[p].w + radius < 0.0) return;
+        }
+        if (hiz_enabled != 0 && IsOccluded(center, radius)) {
+          atomicAdd(occluded, 1u);
+          return;
+        }
+        // the meshes draw the same instances, the first command's count is the slot
+        uint slot = atomicAdd(commands[0].instanceCount, 1u);
+        for (int c = 1; c < command_count; c++) atomicAdd(commands[c].instanceCount, 1u);
+        visible[slot] = m;
+      }
+    )cs");
+  }
+
+  // instances a buffer of instance_count mat4, bounds the sphere of the
+  // meshes in model space, xyz the center and w the radius
+  void Setup(GLuint instances, GLuint instance_count, const glm::vec4 &bounds) {
+    instances_ = instances;
+    instance_count_ = instance_count;
+    bounds_ = bounds;
+    if (visible_buffer_ == 0) glGenBuffers(1, &visible_buffer_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, visible_buffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, instance_count * sizeof(glm::mat4), nullptr, GL_DYNAMIC_COPY);
+    // the occluded instances of the last cull
+    const GLuint zero = 0;
+    if (stats_buffer_ == 0) glGenBuffers(1, &stats_buffer_);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zero), &zero, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+
+  // adds a command drawing the mesh's visible instances, returns its index for Draw()
+  std::size_t AddDraw(const Mesh &mesh) {
+    const VertexPool::Allocation &a = mesh.allocation();
+    const MeshLod lod = mesh.Lod(0);
+    commands_.push_back({lod.index_count, 0, a.first_index + lod.first_index, a.base_vertex, 0});
+    if (command_buffer_ == 0) glGenBuffers(1, &command_buffer_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands_.size() * sizeof(DrawElementsIndirectCommand),
+                 commands_.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return commands_.size() - 1;
+  }
+
+  // culls against the frustum of projection * view, for the draws after it,
+  // and the Hi-Z pyramid of the last UpdateHiZ() bound on hiz_unit. Leaves
+  // the program unbound, call before Use() of the drawing one.
+  void Cull(const glm::mat4 &projection_view, GLint hiz_unit = 9) {
+    if (commands_.empty()) return;
+    // instance counts back to 0
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands_.size() * sizeof(DrawElementsIndirectCommand),
+                    commands_.data());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    const Frustum frustum = Frustum::FromMatrix(projection_view);
+    program_.Use();
+    glUniform4fv(program_.GetUniformLocation(UNIFORM_ID("planes")), 6, &frustum.planes[0][0]);
+    program_.SetVec4(UNIFORM_ID("bounds"), bounds_);
+    program_.SetInt(UNIFORM_ID("instance_count"), static_cast<int>(instance_count_));
+    program_.SetInt(UNIFORM_ID("command_count"), static_cast<int>(commands_.size()));
+    const bool hiz = occlusion_ && hiz_ready_;
+    program_.SetInt(UNIFORM_ID("hiz_enabled"), hiz);
+    if (hiz) {
+      const GLuint zero = 0;
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer_);
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+      glActiveTexture(GL_TEXTURE0 + hiz_unit);
+      glBindTexture(GL_TEXTURE_2D, hiz_texture_);
+      glActiveTexture(GL_TEXTURE0);
+      program_.SetInt(UNIFORM_ID("hiz"), hiz_unit);
+      program_.SetMat4(UNIFORM_ID("hiz_projection_view"), hiz_projection_view_);
+      hiz_cull_count_++;
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instances_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visible_buffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, command_buffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, stats_buffer_);
+    glDispatchCompute((instance_count_ + kLocalSize - 1) / kLocalSize, 1, 1);
+    // the commands and matrices are read by the draws
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    for (GLuint binding = 0; binding < 4; binding++) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    glUseProgram(0);
+    cull_count_++;
+  }
+
+  // copies the depth buffer of the read framebuffer, width x height, and
+  // reduces it into the Hi-Z pyramid for the next Cull(), projection_view
+  // the matrix it was drawn with. At the end of a frame, if submitted with
+  // occlusion. The copy is a blit, which resolves a multisampled depth
+  // buffer but needs the same depth and stencil format on both sides, so the
+  // copy's format is the one queried from the read framebuffer. If there is
+  // none that matches, or the first blit fails, occlusion is turned off.
+  void UpdateHiZ(const glm::mat4 &projection_view, GLsizei width, GLsizei height) {
+    if (!occlusion_ || width <= 0 || height <= 0) return;
+    if (width != depth_width_ || height != depth_height_) {
+      if (!CreateHiZ(width, height)) return DisableOcclusion("no depth format like the framebuffer's");
+    }
+
+    // the first blit after CreateHiZ() checks the formats did match
+    const bool check = !hiz_ready_;
+    if (check) {
+      while (glGetError() != GL_NO_ERROR) {
+      }
+    }
+    GLint draw_framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depth_framebuffer_);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_framebuffer);
+    if (check && glGetError() != GL_NO_ERROR) return DisableOcclusion("the depth buffer blit failed");
+
+    // level 0 is half the depth buffer, each level half the one before
+    reduce_program_.Use();
+    reduce_program_.SetInt(UNIFORM_ID("source"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    GLsizei level_width = width, level_height = height;
+    for (GLint level = 0; level < hiz_levels_; level++) {
+      level_width = std::max(1, level_width / 2);
+      level_height = std::max(1, level_height / 2);
+      glBindTexture(GL_TEXTURE_2D, level == 0 ? depth_texture_ : hiz_texture_);
+      reduce_program_.SetInt(UNIFORM_ID("source_level"), level == 0 ? 0 : level - 1);
+      glBindImageTexture(0, hiz_texture_, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+      glDispatchCompute((level_width + 7) / 8, (level_height + 7) / 8, 1);
+      // the next level, and the cull, fetch what it wrote
+      glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    hiz_projection_view_ = projection_view;
+    hiz_ready_ = true;
+  }
+
+  // draws the visible instances of the command's mesh, a VAO with the
+  // instanced attributes over visible_buffer() bound
+  void Draw(std::size_t command) const {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+        reinterpret_cast<const void *>(command * sizeof(DrawElementsIndirectCommand)));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+
+  // visible instances of the last Cull(), reads back so waits for the GPU,
+  // for statistics at the end rather than per frame
+  GLuint ReadVisibleCount() const {
+    if (commands_.empty() || cull_count_ == 0) return 0;
+    GLuint count = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer_);
+    glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, offsetof(DrawElementsIndirectCommand, instance_count),
+                       sizeof(count), &count);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    return count;
+  }
+
+  // instances in the frustum but behind the Hi-Z depth in the last Cull()
+  // that tested occlusion, reads back like ReadVisibleCount()
+  GLuint ReadOccludedCount() const {
+    if (stats_buffer_ == 0) return 0;
+    GLuint count = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats_buffer_);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(count), &count);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return count;
+  }
+
+  GLuint visible_buffer() const { return visible_buffer_; }
+  GLuint instance_count() const { return instance_count_; }
+  std::size_t cull_count() const { return cull_count_; }
+  // culls that tested occlusion, the first frame has no pyramid yet
+  std::size_t hiz_cull_count() const { return hiz_cull_count_; }
+  // false once UpdateHiZ() turned it off
+  bool occlusion() const { return occlusion_; }
+
+ private:
+  // the depth format of the read framebuffer's depth buffer, false if there
+  // is none or no texture format matches it
+  static bool ReadDepthFormat(GLenum *internal_format, GLenum *format, GLenum *type, bool *stencil) {
+    GLint read_framebuffer = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
+    // the default framebuffer names its buffers rather than attachments
+    const GLenum depth_attachment = read_framebuffer ? GL_DEPTH_ATTACHMENT : GL_DEPTH;
+    const GLenum stencil_attachment = read_framebuffer ? GL_STENCIL_ATTACHMENT : GL_STENCIL;
+    GLint depth_bits = 0, stencil_bits = 0, component_type = GL_NONE;
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depth_attachment,
+                                          GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depth_bits);
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, depth_attachment,
+                                          GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &component_type);
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, stencil_attachment,
+                                          GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencil_bits);
+    const bool is_float = component_type == GL_FLOAT;
+    *stencil = stencil_bits != 0;
+    if (stencil_bits == 8) {
+      *format = GL_DEPTH_STENCIL;
+      if (depth_bits == 24 && !is_float) {
+        *internal_format = GL_DEPTH24_STENCIL8;
+        *type = GL_UNSIGNED_INT_24_8;
+        return true;
+      }
+      if (depth_bits == 32 && is_float) {
+        *internal_format = GL_DEPTH32F_STENCIL8;
+        *type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+        return true;
+      }
+      return false;
+    }
+    if (stencil_bits != 0) return false;
+    *format = GL_DEPTH_COMPONENT;
+    switch (is_float ? -depth_bits : depth_bits) {
+      case 16: *internal_format = GL_DEPTH_COMPONENT16; *type = GL_UNSIGNED_SHORT; return true;
+      case 24: *internal_format = GL_DEPTH_COMPONENT24; *type = GL_UNSIGNED_INT; return true;
+      case 32: *internal_format = GL_DEPTH_COMPONENT32; *type = GL_UNSIGNED_INT; return true;
+      case -32: *internal_format = GL_DEPTH_COMPONENT32F; *type = GL_FLOAT; return true;
+      default: return false;
+    }
+  }
+
+  void DisableOcclusion(const char *reason) {
+    std::cout << "ERROR::GPU_CULL: " << reason << ", culling the frustum only" << std::endl;
+    occlusion_ = false;
+    hiz_ready_ = false;
+  }
+
+  // false if the depth buffer can't be copied
+  bool CreateHiZ(GLsizei width, GLsizei height) {
+    GLuint textures[] = {depth_texture_, hiz_texture_};
+    glDeleteTextures(2, textures);
+    depth_texture_ = hiz_texture_ = 0;
+    hiz_ready_ = false;
+    depth_width_ = width;
+    depth_height_ = height;
+
+    GLenum internal_format, format, type;
+    bool stencil;
+    if (!ReadDepthFormat(&internal_format, &format, &type, &stencil)) return false;
+    glGenTextures(1, &depth_texture_);
+    glBindTexture(GL_TEXTURE_2D, depth_texture_);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    if (depth_framebuffer_ == 0) glGenFramebuffers(1, &depth_framebuffer_);
+    GLint draw_framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depth_framebuffer_);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, stencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+                           GL_TEXTURE_2D, depth_texture_, 0);
+    glDrawBuffer(GL_NONE);
+    const bool complete = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_framebuffer);
+    if (!complete) return false;
+
+    const GLsizei hiz_width = std::max(1, width / 2), hiz_height = std::max(1, height / 2);
+    hiz_levels_ = 1 + static_cast<GLint>(std::floor(std::log2(std::max(hiz_width, hiz_height))));
+    glGenTextures(1, &hiz_texture_);
+    glBindTexture(GL_TEXTURE_2D, hiz_texture_);
+    glTexStorage2D(GL_TEXTURE_2D, hiz_levels_, GL_R32F, hiz_width, hiz_height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+  }
+
+  Shader program_;
+  GLuint instances_ = 0;
+  GLuint instance_count_ = 0;
+  glm::vec4 bounds_;
+  GLuint visible_buffer_ = 0;
+  GLuint command_buffer_ = 0;
+  std::vector<DrawElementsIndirectCommand> commands_;
+  std::size_t cull_count_ = 0;
+
+  // occlusion, see UpdateHiZ()
+  bool occlusion_ = false;
+  Shader reduce_program_;
+  GLuint stats_buffer_ = 0;
+  GLuint depth_framebuffer_ = 0;
+  GLuint depth_texture_ = 0;
+  GLuint hiz_texture_ = 0;
+  GLsizei depth_width_ = 0, depth_height_ = 0;
+  GLint hiz_levels_ = 0;
+  bool hiz_ready_ = false;  // the pyramid holds a frame
+  glm::mat4 hiz_projection_view_;
+  std::size_t hiz_cull_count_ = 0;
+};
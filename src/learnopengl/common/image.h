@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "mipmap.h"
+
+#include "stb_image_impl.h"
+#include "texture_cache.h"
+
+// decoded image in client memory, could be decoded on any thread
+class Image {
+ public:
+  unsigned char *data = nullptr;
+  int width = 0, height = 0, components = 0;
+  std::vector<MipLevel> mips;  // levels from 1, if built
+
+  Image() = default;
+  explicit Image(const char *path) { Decode(path); }
+
+  Image(const Image &) = delete;
+  Image &operator=(const Image &) = delete;
+
+  Image(Image &&other) noexcept
+    : data(other.data), width(other.width), height(other.height),
+      components(other.components), mips(std::move(other.mips)) {
+    other.data = nullptr;
+  }
+  Image &operator=(Image &&other) noexcept {
+    if (this != &other) {
+      Release();
+      data = other.data;
+      width = other.width;
+      height = other.height;
+      components = other.components;
+      mips = std::move(other.mips);
+      other.data = nullptr;
+    }
+    return *this;
+  }
+
+  ~Image() { Release(); }
+
+  bool Decode(const char *path) {
+    Release();
+    data = stbi_load(path, &width, &height, &components, 0);
+    return data != nullptr;
+  }
+
+  // builds the mipmaps on the calling thread, nothing for MipFilter::kGpu
+  void BuildMips(bool srgb, MipFilter filter) {
+    mips = BuildMipChain(data, width, height, components, srgb, filter);
+  }
+
+  std::size_t LevelSize(int level) const {
+    if (level == 0) return static_cast<std::size_t>(width) * height * components;
+    return mips[level - 1].data.size();
+  }
+  const unsigned char *LevelData(int level) const {
+    return level == 0 ? data : mips[level - 1].data.data();
+  }
+  int LevelCount() const { return data ? 1 + static_cast<int>(mips.size()) : 0; }
+
+  // size of all the levels one after another, as PackLevels() writes them
+  std::size_t PackedSize() const {
+    std::size_t size = 0;
+    for (int i = 0; i < LevelCount(); i++) size += LevelSize(i);
+    return size;
+  }
+  void PackLevels(void *out) const {
+    auto *dst = static_cast<unsigned char *>(out);
+    for (int i = 0; i < LevelCount(); i++) {
+      std::memcpy(dst, LevelData(i), LevelSize(i));
+      dst += LevelSize(i);
+    }
+  }
+
+ private:
+  void Release() {
+    if (data) stbi_image_free(data);
+    data = nullptr;
+    mips.clear();
+  }
+};
+
+// formats of an image with 1, 3 or 4 components, false for others
+inline bool ImageFormat(int components, bool srgb, GLenum *internalFormat, GLenum *dataFormat) {
+  if (components == 1)        {
+    *internalFormat = *dataFormat = GL_RED;
+  } else if (components == 3) {
+    *internalFormat = srgb ? GL_SRGB : GL_RGB;
+    *dataFormat = GL_RGB;
+  } else if (components == 4) {
+    *internalFormat = srgb ? GL_SRGB_ALPHA : GL_RGBA;
+    *dataFormat = GL_RGBA;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// uploads the image with its prebuilt mipmaps, or generates them if it has
+// none, must run on the GL thread. If packed, the levels are read from the
+// bound GL_PIXEL_UNPACK_BUFFER, laid out as Image::PackLevels() does.
+inline bool UploadTexture(GLuint textureID, const Image &image,
+                          const TextureParams &params = TextureParams(), bool packed = false) {
+  GLenum internalFormat;
+  GLenum dataFormat;
+  if (!ImageFormat(image.components, params.srgb, &internalFormat, &dataFormat)) return false;
+
+  // levels are tightly packed, odd widths of RGB rows aren't 4 byte aligned
+  GLint last_alignment = 4;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &last_alignment);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  glBindTexture(GL_TEXTURE_2D, textureID);
+  std::size_t offset = 0;
+  for (int level = 0; level < image.LevelCount(); level++) {
+    int w = level == 0 ? image.width : image.mips[level - 1].width;
+    int h = level == 0 ? image.height : image.mips[level - 1].height;
+    const void *pixels = packed ? reinterpret_cast<const void *>(offset) : image.LevelData(level);
+    glTexImage2D(GL_TEXTURE_2D, level, internalFormat, w, h, 0, dataFormat, GL_UNSIGNED_BYTE, pixels);
+    offset += image.LevelSize(level);
+  }
+  if (image.mips.empty()) {
+    glGenerateMipmap(GL_TEXTURE_2D);
+  } else {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.mips.size()));
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, last_alignment);
+
+  // use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat
+  GLint wrap = params.wrap ? params.wrap : (dataFormat == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.min_filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, params.mag_filter);
+  return true;
+}
+
+// decodes an image and builds its mipmaps as the params ask, for the worker threads
+inline Image DecodeImage(const char *path, const TextureParams &params = TextureParams()) {
+  Image image(path);
+  bool mipmapped = params.min_filter != GL_LINEAR && params.min_filter != GL_NEAREST;
+  if (image.data && mipmapped) image.BuildMips(params.srgb, params.mip_filter);
+  return image;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// Picks the level of detail of a mesh by its screen-space error: the
+// coarsest level whose MeshLod::error, projected at the distance of the
+// instance, stays within max_pixels. Built per frame from the projection,
+// e.g. CameraHelper2::GetPerspectiveMatrix(), and the viewport height.
+class LodSelector {
+ public:
+  LodSelector(const glm::mat4 &projection, float viewport_height, float max_pixels = 1.0f)
+    // pixels of a unit error at distance 1, a perspective projection's [1][1] is cot(fovy / 2)
+    : pixels_per_unit_(projection[1][1] * viewport_height * 0.5f / max_pixels) {}
+
+  // distance from the eye, scale the largest of the instance's transform
+  int Select(const Mesh &mesh, float distance, float scale = 1.0f) const {
+    for (int lod = mesh.LodCount() - 1; lod > 0; lod--) {
+      // its error projected at the distance, in max_pixels
+      if (mesh.Lod(lod).error * scale * pixels_per_unit_ <= distance) return lod;
+    }
+    return 0;
+  }
+
+ private:
+  float pixels_per_unit_;
+};
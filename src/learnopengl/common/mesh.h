@@ -5,13 +5,21 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
 #include <vector>
 
+#include "base/render_queue.h"
+
+#include "mesh_optimizer.h"
+#include "mesh_simplify.h"
+#include "packed_vertex.h"
 #include "shader.h"
+#include "vertex_pool.h"
 
 struct Vertex {
   // position
@@ -26,6 +34,18 @@ struct Vertex {
   glm::vec3 Bitangent;
 };
 
+// attribute layout of Vertex: position 0, normal 1, texCoords 2, tangent 3, bitangent 4
+inline const VertexFormat &MeshVertexFormat() {
+  static const VertexFormat format{sizeof(Vertex), {
+    {0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position)},
+    {1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal)},
+    {2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords)},
+    {3, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Tangent)},
+    {4, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Bitangent)},
+  }};
+  return format;
+}
+
 struct Texture {
   unsigned int id;
   std::string type;
@@ -38,100 +58,249 @@ class Mesh {
   std::vector<Vertex> vertices;
   std::vector<unsigned int> indices;
   std::vector<Texture> textures;
+  // shared by the meshes of a VertexPool chunk, not owned
   unsigned int VAO;
+  // layers of its diffuse, specular, normal and height textures in the
+  // model's texture arrays, -1 for none, see Model::PackTextures()
+  glm::ivec4 texture_layers = glm::ivec4(-1);
+  // vertex cache efficiency of the indices, see Model::processMesh()
+  MeshOptimizeStats optimize_stats;
+  // maps the positions of a packed mesh into its bounds, identity if not packed
+  glm::mat4 position_dequant = glm::mat4(1.0f);
+  // bounding sphere of the vertices, xyz the center and w the radius
+  glm::vec4 bounds = glm::vec4(0.0f);
+  // ranges of its levels of detail in the indices, the full mesh first. empty
+  // if it has none, see Lod()
+  std::vector<MeshLod> lods;
 
   /*  Functions  */
-  // constructor
-  Mesh(std::vector<Vertex> vertices,
-       std::vector<unsigned int> indices,
-       std::vector<Texture> textures) {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
+  // constructor, takes over the geometry without copying it. if packed, the
+  // buffers hold PackedVertex, while vertices keeps the full ones.
+  Mesh(std::vector<Vertex> &&vertices,
+       std::vector<unsigned int> &&indices,
+       std::vector<Texture> &&textures,
+       bool packed = false)
+    : vertices(std::move(vertices)),
+      indices(std::move(indices)),
+      textures(std::move(textures)),
+      VAO(0), packed_(packed) {
+    // now that we have all the required data, copy it into the vertex pool.
+    SetupMesh(this->vertices.data(), this->vertices.size(),
+              this->indices.data(), this->indices.size());
+  }
+
+  // constructor from geometry owned elsewhere (e.g. a mapped mesh cache),
+  // uploaded straight to the buffers, vertices and indices are left empty
+  Mesh(const Vertex *vertex_data, std::size_t vertex_count,
+       const unsigned int *index_data, std::size_t index_count,
+       std::vector<Texture> &&textures,
+       bool packed = false)
+    : textures(std::move(textures)),
+      VAO(0), packed_(packed) {
+    SetupMesh(vertex_data, vertex_count, index_data, index_count);
+  }
+
+  // owns its range of the pool, so it could only be moved
+  Mesh(const Mesh &) = delete;
+  Mesh &operator=(const Mesh &) = delete;
+
+  Mesh(Mesh &&other) noexcept
+    : vertices(std::move(other.vertices)),
+      indices(std::move(other.indices)),
+      textures(std::move(other.textures)),
+      VAO(other.VAO), texture_layers(other.texture_layers),
+      optimize_stats(other.optimize_stats),
+      position_dequant(other.position_dequant),
+      bounds(other.bounds),
+      lods(std::move(other.lods)),
+      packed_(other.packed_),
+      allocation_(other.allocation_),
+      texture_bindings_(std::move(other.texture_bindings_)) {
+    other.VAO = 0;
+    other.allocation_ = VertexPool::Allocation();
+  }
+
+  Mesh &operator=(Mesh &&other) noexcept {
+    if (this != &other) {
+      Release();
+      vertices = std::move(other.vertices);
+      indices = std::move(other.indices);
+      textures = std::move(other.textures);
+      VAO = other.VAO;
+      texture_layers = other.texture_layers;
+      optimize_stats = other.optimize_stats;
+      position_dequant = other.position_dequant;
+      bounds = other.bounds;
+      lods = std::move(other.lods);
+      packed_ = other.packed_;
+      allocation_ = other.allocation_;
+      texture_bindings_ = std::move(other.texture_bindings_);
+      other.VAO = 0;
+      other.allocation_ = VertexPool::Allocation();
+    }
+    return *this;
+  }
+
+  ~Mesh() {
+    Release();
+  }
+
+  // number of indices of the mesh, of all its levels of detail
+  GLsizei IndexCount() const { return allocation_.index_count; }
+  // levels of detail, at least the full mesh
+  int LodCount() const { return lods.empty() ? 1 : static_cast<int>(lods.size()); }
+  MeshLod Lod(int i) const {
+    if (lods.empty()) return {0, allocation_.index_count, 0.0f};
+    return lods[i];
+  }
+  // its range of the vertex pool
+  const VertexPool::Allocation &allocation() const { return allocation_; }
+  // whether its buffers hold PackedVertex, see position_dequant
+  bool packed() const { return packed_; }
+  // the pool of its vertex format
+  VertexPool &pool() const {
+    return VertexPool::ForFormat(packed_ ? PackedVertexFormat() : MeshVertexFormat());
+  }
 
-    // now that we have all the required data, set the vertex buffers and its attribute pointers.
-    SetupMesh();
+  // a new VAO over the pool buffers holding the mesh, e.g. to add instanced
+  // attributes, owned by the caller. Draw it with DrawElements().
+  GLuint CreateVertexArray() const {
+    return pool().CreateVertexArray(allocation_);
   }
 
   // render the mesh
-  void Draw(Shader shader) {
-    // bind appropriate textures
-    unsigned int diffuseNr  = 1;
-    unsigned int specularNr = 1;
-    unsigned int normalNr   = 1;
-    unsigned int heightNr   = 1;
-    unsigned int reflectionNr = 1;
-    for (unsigned int i = 0; i < textures.size(); i++) {
-      glActiveTexture(GL_TEXTURE0 + i);  // active proper texture unit before binding
-      // retrieve texture number (the N in diffuse_textureN)
-      std::string number;
-      std::string name = textures[i].type;
-      if (name == "material.texture_diffuse")
-        number = std::to_string(diffuseNr++);
-      else if (name == "material.texture_specular")
-        number = std::to_string(specularNr++);
-      else if (name == "material.texture_normal")
-        number = std::to_string(normalNr++);
-      else if (name == "material.texture_height")
-        number = std::to_string(heightNr++);
-      else if (name == "material.texture_reflection")
-        number = std::to_string(reflectionNr++);
+  void Draw(const Shader &shader) const {
+    BindTextures(shader);
+
+    // draw mesh
+    DrawGeometry();
+
+    // always good practice to set everything back to defaults once configured.
+    glActiveTexture(GL_TEXTURE0);
+  }
 
+  // bind appropriate textures, the sampler names are resolved once per shader
+  void BindTextures(const Shader &shader) const {
+    for (auto &&binding : GetTextureBindings(shader)) {
+      glActiveTexture(GL_TEXTURE0 + binding.unit);  // active proper texture unit before binding
       // now set the sampler to the correct texture unit
-      glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+      if (binding.location >= 0) glUniform1i(binding.location, binding.unit);
       // and finally bind the texture
-      glBindTexture(GL_TEXTURE_2D, textures[i].id);
+      glBindTexture(GL_TEXTURE_2D, binding.id);
     }
+  }
 
-    // draw mesh
+  // draws without binding its textures, e.g. when they're in bound arrays
+  void DrawGeometry() const {
     glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    DrawElements();
     glBindVertexArray(0);
+  }
 
-    // always good practice to set everything back to defaults once configured.
-    glActiveTexture(GL_TEXTURE0);
+  // draws with the VAO already bound, the shared one or from CreateVertexArray()
+  void DrawElements(GLsizei instances = 1, int lod = 0) const {
+    MeshLod range = Lod(lod);
+    VertexPool::Allocation a = allocation_;
+    a.first_index += range.first_index;
+    a.index_count = range.index_count;
+    pool().DrawElements(a, instances);
+  }
+
+  // id of its textures for RenderQueue keys, meshes with the same first one mostly share them
+  std::uint32_t MaterialId() const { return textures.empty() ? 0 : textures[0].id; }
+
+  // adds its textures for the shader to the packet begun on the queue, as BindTextures()
+  void RecordTextures(RenderQueue *queue, const Shader &shader) const {
+    for (auto &&binding : GetTextureBindings(shader)) {
+      queue->BindTexture({static_cast<GLuint>(binding.unit), GL_TEXTURE_2D, binding.id, binding.location});
+    }
+  }
+
+  // ends the packet begun on the queue with the draw, as DrawElements() on VAO
+  void RecordDrawElements(RenderQueue *queue, GLsizei instances = 1, int lod = 0) const {
+    MeshLod range = Lod(lod);
+    const std::size_t first_index = allocation_.first_index + range.first_index;
+    queue->DrawElements(GL_TRIANGLES, range.index_count, first_index * sizeof(GLuint),
+                        allocation_.base_vertex, instances);
   }
 
  private:
+  struct TextureBinding {
+    GLint unit;
+    GLuint id;
+    GLint location;
+  };
+
   /*  Render data  */
-  unsigned int VBO, EBO;
+  bool packed_;
+  VertexPool::Allocation allocation_;
+  // texture bindings per shader program, a mesh may be drawn by several,
+  // keyed by Shader::generation() as a deleted program's ID may come back
+  mutable std::vector<std::pair<std::uint64_t, std::vector<TextureBinding>>> texture_bindings_;
 
   /*  Functions  */
-  // initializes all the buffer objects/arrays
-  void SetupMesh() {
-    // create buffers/arrays
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+  const std::vector<TextureBinding> &GetTextureBindings(const Shader &shader) const {
+    for (auto &&bindings : texture_bindings_) {
+      if (bindings.first == shader.generation()) return bindings.second;
+    }
 
-    glBindVertexArray(VAO);
-    // load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    // A great thing about structs is that their memory layout is sequential for all its items.
-    // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-    // again translates to 3/2 floats which translates to a byte array.
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-    // set the vertex attribute pointers
-    // vertex Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-    // vertex texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-    // vertex tangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-    // vertex bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+    std::vector<TextureBinding> bindings;
+    bindings.reserve(textures.size());
+    for (unsigned int i = 0; i < textures.size(); i++) {
+      // retrieve texture number (the N in diffuse_textureN)
+      unsigned int number = 1;
+      for (unsigned int j = 0; j < i; j++) {
+        if (textures[j].type == textures[i].type) number++;
+      }
+      std::string name = textures[i].type + std::to_string(number);
+      GLint location = shader.GetUniformLocation(name.c_str());
+      if (location < 0) {
+        // samplers may also live in a Material struct
+        location = shader.GetUniformLocation(("material." + name).c_str());
+      }
+      bindings.push_back({static_cast<GLint>(i), textures[i].id, location});
+    }
+    texture_bindings_.emplace_back(shader.generation(), std::move(bindings));
+    return texture_bindings_.back().second;
+  }
 
-    glBindVertexArray(0);
+  // returns its range to the pool, textures are owned by the model
+  void Release() {
+    if (allocation_.valid()) pool().Free(allocation_);
+    allocation_ = VertexPool::Allocation();
+    VAO = 0;
+  }
+
+  // copies the geometry into the vertex pool, the VAO is its chunk's
+  void SetupMesh(const Vertex *vertex_data, std::size_t vertex_count,
+                 const unsigned int *index_data, std::size_t index_count) {
+    if (vertex_count) {
+      glm::vec3 lo = vertex_data[0].Position, hi = lo;
+      for (std::size_t i = 1; i < vertex_count; i++) {
+        lo = glm::min(lo, vertex_data[i].Position);
+        hi = glm::max(hi, vertex_data[i].Position);
+      }
+      glm::vec3 center = (lo + hi) * 0.5f;
+      float radius = 0.0f;
+      for (std::size_t i = 0; i < vertex_count; i++) {
+        radius = std::max(radius, glm::length(vertex_data[i].Position - center));
+      }
+      bounds = glm::vec4(center, radius);
+    }
+    if (!packed_) {
+      allocation_ = pool().Allocate(vertex_data, vertex_count, index_data, index_count);
+      VAO = allocation_.vao;
+      return;
+    }
+    PositionQuantization quantization;
+    for (std::size_t i = 0; i < vertex_count; i++) quantization.Add(vertex_data[i].Position);
+    std::vector<PackedVertex> packed(vertex_count);
+    for (std::size_t i = 0; i < vertex_count; i++) {
+      const Vertex &v = vertex_data[i];
+      packed[i] = PackVertex(quantization, v.Position, v.Normal, v.TexCoords, v.Tangent, v.Bitangent);
+    }
+    position_dequant = quantization.Dequantization();
+    allocation_ = pool().Allocate(packed.data(), vertex_count, index_data, index_count);
+    VAO = allocation_.vao;
   }
 };
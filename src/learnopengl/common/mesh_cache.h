@@ -0,0 +1,386 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "mesh.h"
+
+// Binary cache of an imported model, written next to it as <model>.meshcache
+//
+//   MeshCacheHeader
+//   MeshCacheEntry[mesh_count]            mesh table
+//   Vertex[vertex_count]                  interleaved vertex blob
+//   uint32_t[index_count]                 index blob, the LODs after each mesh's own indices
+//   MeshLod[lod_count]                    LOD table
+//   MeshCacheTexture[texture_count]       material table
+//   char[]                                material strings
+//
+// Blobs are 16-byte aligned, so a mapped file could be handed to glBufferData
+// directly. It is invalidated when the source's mtime, size or hash changes,
+// or when it was optimized with other MeshOptimizeFlags.
+
+struct MeshCacheHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t vertex_size;  // sizeof(Vertex), guards the layout
+  std::uint32_t optimize_flags;  // MeshOptimizeFlags the geometry went through
+  std::uint64_t source_mtime;
+  std::uint64_t source_size;
+  std::uint64_t source_hash;
+  std::uint32_t mesh_count;
+  std::uint32_t texture_count;
+  std::uint32_t lod_count;
+  std::uint32_t reserved;
+  std::uint64_t meshes_offset;
+  std::uint64_t vertices_offset;
+  std::uint64_t indices_offset;
+  std::uint64_t lods_offset;
+  std::uint64_t textures_offset;
+  std::uint64_t strings_offset;
+  std::uint64_t file_size;
+};
+
+struct MeshCacheEntry {
+  std::uint64_t first_vertex;
+  std::uint64_t vertex_count;
+  std::uint64_t first_index;
+  std::uint64_t index_count;
+  std::uint32_t first_texture;
+  std::uint32_t texture_count;
+  std::uint32_t first_lod;
+  std::uint32_t lod_count;
+  MeshOptimizeStats optimize_stats;
+};
+
+struct MeshCacheTexture {
+  std::uint32_t type_offset;  // into the strings
+  std::uint32_t type_length;
+  std::uint32_t path_offset;
+  std::uint32_t path_length;
+};
+
+constexpr char kMeshCacheMagic[8] = {'G', 'L', 'M', 'E', 'S', 'H', 'C', '\0'};
+constexpr std::uint32_t kMeshCacheVersion = 3;
+
+// Read-only file mapping, falls back to reading it into memory on Windows
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile() { Close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool Open(const std::string &path) {
+    Close();
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    buffer_.resize(static_cast<std::size_t>(in.tellg()));
+    in.seekg(0);
+    if (!in.read(buffer_.data(), buffer_.size())) return false;
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+      close(fd);
+      return false;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return false;
+    data_ = static_cast<const char *>(addr);
+    size_ = st.st_size;
+#endif
+    return true;
+  }
+
+  void Close() {
+#ifdef _WIN32
+    buffer_.clear();
+#else
+    if (data_) munmap(const_cast<char *>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  const char *data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+ private:
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+#ifdef _WIN32
+  std::vector<char> buffer_;
+#endif
+};
+
+// Identity of the source model file
+struct MeshCacheSource {
+  std::uint64_t mtime = 0;
+  std::uint64_t size = 0;
+  std::uint64_t hash = 0;
+
+  bool Read(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    mtime = static_cast<std::uint64_t>(st.st_mtime);
+    size = static_cast<std::uint64_t>(st.st_size);
+
+    MappedFile file;
+    if (!file.Open(path)) return false;
+    // FNV-1a
+    hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < file.size(); i++) {
+      hash ^= static_cast<unsigned char>(file.data()[i]);
+      hash *= 1099511628211ull;
+    }
+    return true;
+  }
+};
+
+// Mapped cache file, the geometry pointers stay valid while it is open
+class MeshCacheFile {
+ public:
+  bool Open(const std::string &path, const MeshCacheSource &source, std::uint32_t optimize_flags) {
+    if (!file_.Open(path)) return false;
+    if (file_.size() < sizeof(MeshCacheHeader)) return Invalid();
+    header_ = reinterpret_cast<const MeshCacheHeader *>(file_.data());
+    if (std::memcmp(header_->magic, kMeshCacheMagic, sizeof(kMeshCacheMagic)) != 0 ||
+        header_->version != kMeshCacheVersion ||
+        header_->vertex_size != sizeof(Vertex) ||
+        header_->optimize_flags != optimize_flags ||
+        header_->file_size != file_.size()) {
+      return Invalid();
+    }
+    if (header_->source_mtime != source.mtime ||
+        header_->source_size != source.size ||
+        header_->source_hash != source.hash) {
+      return Invalid();  // the model changed
+    }
+    if (!Validate()) {
+      std::cout << "ERROR::MESH_CACHE: corrupt " << path << std::endl;
+      return Invalid();
+    }
+    return true;
+  }
+
+  std::uint32_t mesh_count() const { return header_->mesh_count; }
+
+  const MeshCacheEntry &mesh(std::uint32_t i) const {
+    return At<MeshCacheEntry>(header_->meshes_offset)[i];
+  }
+  const Vertex *vertices(const MeshCacheEntry &mesh) const {
+    return At<Vertex>(header_->vertices_offset) + mesh.first_vertex;
+  }
+  const std::uint32_t *indices(const MeshCacheEntry &mesh) const {
+    return At<std::uint32_t>(header_->indices_offset) + mesh.first_index;
+  }
+  std::vector<MeshLod> lods(const MeshCacheEntry &mesh) const {
+    const MeshLod *first = At<MeshLod>(header_->lods_offset) + mesh.first_lod;
+    return std::vector<MeshLod>(first, first + mesh.lod_count);
+  }
+
+  std::string texture_type(std::uint32_t i) const {
+    const auto &t = At<MeshCacheTexture>(header_->textures_offset)[i];
+    return std::string(At<char>(header_->strings_offset) + t.type_offset, t.type_length);
+  }
+  std::string texture_path(std::uint32_t i) const {
+    const auto &t = At<MeshCacheTexture>(header_->textures_offset)[i];
+    return std::string(At<char>(header_->strings_offset) + t.path_offset, t.path_length);
+  }
+
+ private:
+  template <typename T>
+  const T *At(std::uint64_t offset) const {
+    return reinterpret_cast<const T *>(file_.data() + offset);
+  }
+
+  // whether count Ts at offset are aligned and within the file, without overflowing
+  template <typename T>
+  bool InFile(std::uint64_t offset, std::uint64_t count) const {
+    const std::uint64_t size = file_.size();
+    return offset % alignof(T) == 0 && offset <= size && count <= (size - offset) / sizeof(T);
+  }
+
+  // whether first + count is within [0, total]
+  static bool InRange(std::uint64_t first, std::uint64_t count, std::uint64_t total) {
+    return first <= total && count <= total - first;
+  }
+
+  // every table and every range the accessors read, so a truncated or
+  // otherwise broken file is imported again instead of read out of bounds
+  bool Validate() const {
+    const MeshCacheHeader &h = *header_;
+    if (h.vertices_offset < h.meshes_offset || h.indices_offset < h.vertices_offset ||
+        h.lods_offset < h.indices_offset || h.textures_offset < h.lods_offset ||
+        h.strings_offset < h.textures_offset || h.strings_offset > file_.size()) {
+      return false;
+    }
+    // each blob ends where the next begins, at most
+    const std::uint64_t vertex_count = (h.indices_offset - h.vertices_offset) / sizeof(Vertex);
+    const std::uint64_t index_count = (h.lods_offset - h.indices_offset) / sizeof(std::uint32_t);
+    const std::uint64_t strings_size = file_.size() - h.strings_offset;
+    if (!InFile<MeshCacheEntry>(h.meshes_offset, h.mesh_count) ||
+        h.meshes_offset + h.mesh_count * std::uint64_t(sizeof(MeshCacheEntry)) > h.vertices_offset ||
+        !InFile<Vertex>(h.vertices_offset, vertex_count) ||
+        !InFile<std::uint32_t>(h.indices_offset, index_count) ||
+        !InFile<MeshLod>(h.lods_offset, h.lod_count) ||
+        h.lods_offset + h.lod_count * std::uint64_t(sizeof(MeshLod)) > h.textures_offset ||
+        !InFile<MeshCacheTexture>(h.textures_offset, h.texture_count) ||
+        h.textures_offset + h.texture_count * std::uint64_t(sizeof(MeshCacheTexture)) > h.strings_offset) {
+      return false;
+    }
+
+    const MeshCacheEntry *meshes = At<MeshCacheEntry>(h.meshes_offset);
+    const MeshLod *lods = At<MeshLod>(h.lods_offset);
+    for (std::uint32_t i = 0; i < h.mesh_count; i++) {
+      const MeshCacheEntry &mesh = meshes[i];
+      if (!InRange(mesh.first_vertex, mesh.vertex_count, vertex_count) ||
+          !InRange(mesh.first_index, mesh.index_count, index_count) ||
+          !InRange(mesh.first_texture, mesh.texture_count, h.texture_count) ||
+          !InRange(mesh.first_lod, mesh.lod_count, h.lod_count)) {
+        return false;
+      }
+      // the LODs index into the mesh's own indices
+      for (std::uint32_t l = 0; l < mesh.lod_count; l++) {
+        const MeshLod &lod = lods[mesh.first_lod + l];
+        if (!InRange(lod.first_index, lod.index_count, mesh.index_count)) return false;
+      }
+    }
+
+    const MeshCacheTexture *textures = At<MeshCacheTexture>(h.textures_offset);
+    for (std::uint32_t i = 0; i < h.texture_count; i++) {
+      const MeshCacheTexture &t = textures[i];
+      if (!InRange(t.type_offset, t.type_length, strings_size) ||
+          !InRange(t.path_offset, t.path_length, strings_size)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Invalid() {
+    file_.Close();
+    header_ = nullptr;
+    return false;
+  }
+
+  MappedFile file_;
+  const MeshCacheHeader *header_ = nullptr;
+};
+
+// Writes the meshes with their CPU-side geometry, returns false on failure
+inline bool WriteMeshCache(const std::string &path,
+                           const MeshCacheSource &source,
+                           std::uint32_t optimize_flags,
+                           const std::vector<Mesh> &meshes) {
+  auto align = [](std::uint64_t offset) { return (offset + 15) & ~std::uint64_t(15); };
+
+  std::vector<MeshCacheEntry> entries;
+  std::vector<MeshCacheTexture> textures;
+  std::vector<MeshLod> lods;
+  std::string strings;
+  std::uint64_t vertex_count = 0, index_count = 0;
+  for (auto &&mesh : meshes) {
+    MeshCacheEntry e;
+    e.first_vertex = vertex_count;
+    e.vertex_count = mesh.vertices.size();
+    e.first_index = index_count;
+    e.index_count = mesh.indices.size();
+    e.first_texture = textures.size();
+    e.texture_count = mesh.textures.size();
+    e.first_lod = lods.size();
+    e.lod_count = mesh.lods.size();
+    lods.insert(lods.end(), mesh.lods.begin(), mesh.lods.end());
+    e.optimize_stats = mesh.optimize_stats;
+    for (auto &&texture : mesh.textures) {
+      MeshCacheTexture t;
+      t.type_offset = strings.size();
+      t.type_length = texture.type.size();
+      strings += texture.type;
+      t.path_offset = strings.size();
+      t.path_length = texture.path.size();
+      strings += texture.path;
+      textures.push_back(t);
+    }
+    entries.push_back(e);
+    vertex_count += e.vertex_count;
+    index_count += e.index_count;
+  }
+
+  MeshCacheHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kMeshCacheMagic, sizeof(kMeshCacheMagic));
+  header.version = kMeshCacheVersion;
+  header.vertex_size = sizeof(Vertex);
+  header.optimize_flags = optimize_flags;
+  header.source_mtime = source.mtime;
+  header.source_size = source.size;
+  header.source_hash = source.hash;
+  header.mesh_count = entries.size();
+  header.texture_count = textures.size();
+  header.lod_count = lods.size();
+  header.meshes_offset = align(sizeof(header));
+  header.vertices_offset = align(header.meshes_offset + entries.size() * sizeof(MeshCacheEntry));
+  header.indices_offset = align(header.vertices_offset + vertex_count * sizeof(Vertex));
+  header.lods_offset = align(header.indices_offset + index_count * sizeof(std::uint32_t));
+  header.textures_offset = align(header.lods_offset + lods.size() * sizeof(MeshLod));
+  header.strings_offset = header.textures_offset + textures.size() * sizeof(MeshCacheTexture);
+  header.file_size = header.strings_offset + strings.size();
+
+  // write then rename, so a reader never maps a partial file
+  std::string path_tmp = path + ".tmp";
+  {
+    std::ofstream out(path_tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      std::cout << "ERROR::MESH_CACHE_WRITE: " << path_tmp << std::endl;
+      return false;
+    }
+    auto pad = [&out](std::uint64_t offset) {
+      static const char zeros[16] = {};
+      out.write(zeros, offset - static_cast<std::uint64_t>(out.tellp()));
+    };
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    pad(header.meshes_offset);
+    out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+    pad(header.vertices_offset);
+    for (auto &&mesh : meshes) {
+      out.write(reinterpret_cast<const char *>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+    }
+    pad(header.indices_offset);
+    for (auto &&mesh : meshes) {
+      static_assert(sizeof(unsigned int) == sizeof(std::uint32_t), "32-bit indices");
+      out.write(reinterpret_cast<const char *>(mesh.indices.data()), mesh.indices.size() * sizeof(std::uint32_t));
+    }
+    pad(header.lods_offset);
+    out.write(reinterpret_cast<const char *>(lods.data()), lods.size() * sizeof(MeshLod));
+    pad(header.textures_offset);
+    out.write(reinterpret_cast<const char *>(textures.data()), textures.size() * sizeof(MeshCacheTexture));
+    out.write(strings.data(), strings.size());
+    if (!out) {
+      std::cout << "ERROR::MESH_CACHE_WRITE: " << path_tmp << std::endl;
+      return false;
+    }
+  }
+#ifdef _WIN32
+  std::remove(path.c_str());
+#endif
+  return std::rename(path_tmp.c_str(), path.c_str()) == 0;
+}
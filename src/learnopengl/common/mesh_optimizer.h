@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Import-time index/vertex reordering of triangle lists, all CPU-side so it
+// could run on the worker converting the mesh.
+//
+// OptimizeVertexCache() is Tom Forsyth's linear-speed vertex cache
+// optimization, OptimizeOverdraw() then sorts the clusters that start with a
+// cold cache so outward facing ones come first, and OptimizeVertexFetch()
+// renumbers the vertices in the order the triangles use them.
+
+// post-transform cache efficiency of an index order, for a FIFO cache
+struct VertexCacheStats {
+  float acmr = 0;  // average cache miss ratio, transformed vertices per triangle, 0.5 is ideal
+  float atvr = 0;  // average transform to vertex ratio, 1 is ideal
+};
+
+constexpr unsigned int kVertexCacheStatsSize = 16;
+
+// of a mesh, as imported and after the passes
+struct MeshOptimizeStats {
+  VertexCacheStats source;
+  VertexCacheStats optimized;
+};
+
+// passes run on import, they're part of the mesh cache's identity
+enum MeshOptimizeFlags : std::uint32_t {
+  kMeshOptimizeVertexCache = 1 << 0,
+  kMeshOptimizeOverdraw = 1 << 1,
+  kMeshOptimizeVertexFetch = 1 << 2,
+  kMeshOptimizeLods = 1 << 3,  // see BuildLodChain()
+  kMeshOptimizeDefault = kMeshOptimizeVertexCache | kMeshOptimizeVertexFetch | kMeshOptimizeLods,
+};
+
+inline VertexCacheStats AnalyzeVertexCache(const unsigned int *indices, std::size_t index_count,
+                                           std::size_t vertex_count,
+                                           unsigned int cache_size = kVertexCacheStatsSize) {
+  VertexCacheStats stats;
+  if (index_count < 3 || vertex_count == 0) return stats;
+  // timestamp of the load of each vertex, it's cached while within cache_size loads
+  std::vector<std::size_t> loaded(vertex_count, 0);
+  std::size_t misses = 0;
+  for (std::size_t i = 0; i < index_count; i++) {
+    unsigned int v = indices[i];
+    if (loaded[v] == 0 || misses + 1 - loaded[v] > cache_size) {
+      misses++;
+      loaded[v] = misses;
+    }
+  }
+  std::size_t used = 0;
+  for (auto &&l : loaded) used += l != 0;
+  stats.acmr = static_cast<float>(misses) / (index_count / 3);
+  stats.atvr = used ? static_cast<float>(misses) / used : 0.0f;
+  return stats;
+}
+
+namespace mesh_optimizer {
+
+constexpr int kCacheSize = 32;  // LRU cache modelled while optimizing
+
+inline float VertexScore(int cache_position, unsigned int live_triangles) {
+  if (live_triangles == 0) return -1.0f;
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      // the last triangle's vertices, scored low so the strip doesn't turn back
+      score = 0.75f;
+    } else {
+      float scale = 1.0f / (kCacheSize - 3);
+      score = std::pow(1.0f - (cache_position - 3) * scale, 1.5f);
+    }
+  }
+  // boost the vertices with few triangles left, to finish them off
+  return score + 2.0f / std::sqrt(static_cast<float>(live_triangles));
+}
+
+}  // namespace mesh_optimizer
+
+// reorders the triangles in place for the post-transform vertex cache
+inline void OptimizeVertexCache(unsigned int *indices, std::size_t index_count, std::size_t vertex_count) {
+  using mesh_optimizer::kCacheSize;
+  using mesh_optimizer::VertexScore;
+  const std::size_t triangle_count = index_count / 3;
+  if (triangle_count < 2 || vertex_count == 0) return;
+
+  // triangles of each vertex, live ones first in its span
+  std::vector<unsigned int> live(vertex_count, 0);
+  for (std::size_t i = 0; i < triangle_count * 3; i++) live[indices[i]]++;
+  std::vector<std::size_t> first(vertex_count + 1, 0);
+  for (std::size_t v = 0; v < vertex_count; v++) first[v + 1] = first[v] + live[v];
+  std::vector<unsigned int> adjacency(first[vertex_count]);
+  {
+    std::vector<std::size_t> fill(first.begin(), first.end() - 1);
+    for (std::size_t t = 0; t < triangle_count; t++) {
+      for (int k = 0; k < 3; k++) adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+    }
+  }
+
+  std::vector<float> vertex_score(vertex_count);
+  for (std::size_t v = 0; v < vertex_count; v++) vertex_score[v] = VertexScore(-1, live[v]);
+  std::vector<float> triangle_score(triangle_count);
+  std::vector<char> emitted(triangle_count, 0);
+  std::size_t best = 0;
+  for (std::size_t t = 0; t < triangle_count; t++) {
+    const unsigned int *tri = &indices[t * 3];
+    triangle_score[t] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+    if (triangle_score[t] > triangle_score[best]) best = t;
+  }
+
+  std::vector<unsigned int> output;
+  output.reserve(triangle_count * 3);
+  std::vector<unsigned int> cache, next_cache;
+  cache.reserve(kCacheSize + 3);
+  next_cache.reserve(kCacheSize + 3);
+  std::size_t cursor = 0;  // for picking a triangle once none in the cache has a score
+
+  for (std::size_t n = 0; n < triangle_count; n++) {
+    if (best == triangle_count) {
+      while (emitted[cursor]) cursor++;
+      best = cursor;
+    }
+    const unsigned int tri[3] = {indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2]};
+    emitted[best] = 1;
+    output.insert(output.end(), tri, tri + 3);
+
+    // drop the triangle from its vertices' live spans
+    for (unsigned int v : tri) {
+      unsigned int *span = &adjacency[first[v]];
+      for (unsigned int i = 0; i < live[v]; i++) {
+        if (span[i] == best) {
+          std::swap(span[i], span[live[v] - 1]);
+          break;
+        }
+      }
+      live[v]--;
+    }
+
+    // its vertices go to the front of the LRU cache
+    next_cache.assign(tri, tri + 3);
+    for (unsigned int v : cache) {
+      if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.push_back(v);
+    }
+    // the evicted ones lose their cache score
+    for (std::size_t i = kCacheSize; i < next_cache.size(); i++) {
+      unsigned int v = next_cache[i];
+      vertex_score[v] = VertexScore(-1, live[v]);
+      for (std::size_t j = first[v]; j < first[v] + live[v]; j++) {
+        const unsigned int *other = &indices[adjacency[j] * 3];
+        triangle_score[adjacency[j]] = vertex_score[other[0]] + vertex_score[other[1]] + vertex_score[other[2]];
+      }
+    }
+    if (next_cache.size() > static_cast<std::size_t>(kCacheSize)) next_cache.resize(kCacheSize);
+    cache.swap(next_cache);
+
+    // rescore the cached vertices and their triangles, the best of them is next
+    for (std::size_t i = 0; i < cache.size(); i++) {
+      vertex_score[cache[i]] = VertexScore(static_cast<int>(i), live[cache[i]]);
+    }
+    best = triangle_count;
+    float best_score = -1.0f;
+    for (unsigned int v : cache) {
+      for (std::size_t j = first[v]; j < first[v] + live[v]; j++) {
+        unsigned int t = adjacency[j];
+        const unsigned int *other = &indices[t * 3];
+        triangle_score[t] = vertex_score[other[0]] + vertex_score[other[1]] + vertex_score[other[2]];
+        if (triangle_score[t] > best_score) {
+          best_score = triangle_score[t];
+          best = t;
+        }
+      }
+    }
+  }
+  std::copy(output.begin(), output.end(), indices);
+}
+
+// Sorts the clusters of a cache optimized order, the runs of triangles
+// starting where the cache is cold, so the ones facing away from the center
+// of the mesh are drawn first and occlude the rest. The cache efficiency is
+// kept, as the clusters start with misses anyway. position(v) returns the
+// position of vertex v as a type with x, y and z.
+template <typename PositionFn>
+void OptimizeOverdraw(unsigned int *indices, std::size_t index_count, std::size_t vertex_count,
+                      PositionFn position) {
+  const std::size_t triangle_count = index_count / 3;
+  if (triangle_count < 2 || vertex_count == 0) return;
+
+  // cluster starts, the triangles whose vertices all miss the FIFO cache
+  std::vector<std::size_t> starts;
+  std::vector<std::size_t> loaded(vertex_count, 0);
+  std::size_t misses = 0;
+  for (std::size_t t = 0; t < triangle_count; t++) {
+    int triangle_misses = 0;
+    for (int k = 0; k < 3; k++) {
+      unsigned int v = indices[t * 3 + k];
+      if (loaded[v] == 0 || misses + 1 - loaded[v] > kVertexCacheStatsSize) {
+        misses++;
+        loaded[v] = misses;
+        triangle_misses++;
+      }
+    }
+    if (t == 0 || triangle_misses == 3) starts.push_back(t);
+  }
+  starts.push_back(triangle_count);
+  if (starts.size() <= 2) return;
+
+  // area weighted centroids and normals
+  struct Cluster {
+    std::size_t begin, end;
+    float centroid[3], normal[3], area;
+    float key;
+  };
+  std::vector<Cluster> clusters;
+  float center[3] = {0, 0, 0}, total_area = 0;
+  for (std::size_t c = 0; c + 1 < starts.size(); c++) {
+    Cluster cluster = {starts[c], starts[c + 1], {0, 0, 0}, {0, 0, 0}, 0, 0};
+    for (std::size_t t = cluster.begin; t < cluster.end; t++) {
+      auto p0 = position(indices[t * 3]), p1 = position(indices[t * 3 + 1]), p2 = position(indices[t * 3 + 2]);
+      float e1[3] = {p1.x - p0.x, p1.y - p0.y, p1.z - p0.z};
+      float e2[3] = {p2.x - p0.x, p2.y - p0.y, p2.z - p0.z};
+      float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      float c3[3] = {(p0.x + p1.x + p2.x) / 3, (p0.y + p1.y + p2.y) / 3, (p0.z + p1.z + p2.z) / 3};
+      for (int k = 0; k < 3; k++) {
+        cluster.centroid[k] += c3[k] * area;
+        cluster.normal[k] += n[k];
+      }
+      cluster.area += area;
+    }
+    for (int k = 0; k < 3; k++) center[k] += cluster.centroid[k];
+    total_area += cluster.area;
+    if (cluster.area > 0) {
+      for (int k = 0; k < 3; k++) cluster.centroid[k] /= cluster.area;
+    }
+    clusters.push_back(cluster);
+  }
+  if (total_area > 0) {
+    for (int k = 0; k < 3; k++) center[k] /= total_area;
+  }
+  for (auto &&cluster : clusters) {
+    float length = std::sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] +
+                             cluster.normal[2] * cluster.normal[2]);
+    float d = 0;
+    for (int k = 0; k < 3; k++) d += (cluster.centroid[k] - center[k]) * cluster.normal[k];
+    cluster.key = length > 0 ? d / length : 0;
+  }
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster &a, const Cluster &b) { return a.key > b.key; });
+
+  std::vector<unsigned int> output;
+  output.reserve(triangle_count * 3);
+  for (auto &&cluster : clusters) {
+    output.insert(output.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+  }
+  std::copy(output.begin(), output.end(), indices);
+}
+
+// Renumbers the vertices in the order the indices first use them, dropping
+// the unused ones, so the vertex fetch walks the buffer forward.
+template <typename V>
+void OptimizeVertexFetch(std::vector<V> *vertices, unsigned int *indices, std::size_t index_count) {
+  const unsigned int kUnused = ~0u;
+  std::vector<unsigned int> remap(vertices->size(), kUnused);
+  std::vector<V> reordered;
+  reordered.reserve(vertices->size());
+  for (std::size_t i = 0; i < index_count; i++) {
+    unsigned int &r = remap[indices[i]];
+    if (r == kUnused) {
+      r = static_cast<unsigned int>(reordered.size());
+      reordered.push_back((*vertices)[indices[i]]);
+    }
+    indices[i] = r;
+  }
+  vertices->swap(reordered);
+}
@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh_optimizer.h"
+
+// index range of a level of detail in the mesh's index buffer, all levels
+// share its vertices. error is the geometric error of the level in model
+// units, the distance its surface may be off the full mesh's.
+struct MeshLod {
+  std::uint32_t first_index;
+  std::uint32_t index_count;
+  float error;
+};
+
+constexpr int kMaxMeshLods = 5;
+// the error a level may reach, of the diagonal of the mesh's bounds
+constexpr float kMeshLodMaxError = 0.05f;
+
+namespace mesh_simplify {
+
+// symmetric 4x4 matrix of a sum of squared plane distances, with the area
+// weights summed to normalize it into a mean squared distance
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0, c = 0;
+  double weight = 0;
+
+  static Quadric FromPlane(const glm::vec3 &n, double d, double weight) {
+    Quadric q;
+    q.a00 = weight * n.x * n.x; q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z;
+    q.a11 = weight * n.y * n.y; q.a12 = weight * n.y * n.z; q.a22 = weight * n.z * n.z;
+    q.b0 = weight * n.x * d; q.b1 = weight * n.y * d; q.b2 = weight * n.z * d;
+    q.c = weight * d * d;
+    q.weight = weight;
+    return q;
+  }
+
+  Quadric &operator+=(const Quadric &o) {
+    a00 += o.a00; a01 += o.a01; a02 += o.a02; a11 += o.a11; a12 += o.a12; a22 += o.a22;
+    b0 += o.b0; b1 += o.b1; b2 += o.b2; c += o.c;
+    weight += o.weight;
+    return *this;
+  }
+
+  // mean squared distance of p to the planes
+  double Error(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+               2 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0 ? std::max(0.0, e) / weight : 0.0;
+  }
+};
+
+}  // namespace mesh_simplify
+
+// Simplifies a triangle list by half-edge collapses ordered by quadric error
+// metrics (Garland and Heckbert), keeping the vertices so the result indexes
+// the same vertex buffer. Until the index count reaches target_index_count,
+// or the next collapse would move the surface more than target_error.
+//
+// Vertices are welded by position for the topology. Those on borders and
+// non-manifold edges are locked, and a collapse also pays for the attributes
+// it changes, a corner taking the vertex with the closest normal and
+// texture coordinates at the kept position, so UV seams hold. Collapses that
+// would flip a triangle are skipped. V needs Position, Normal and TexCoords.
+// Returns the new indices, the error reached in *result_error.
+template <typename V>
+std::vector<unsigned int> SimplifyMesh(const std::vector<V> &vertices, const std::vector<unsigned int> &indices,
+                                       std::size_t target_index_count, float target_error,
+                                       float *result_error = nullptr) {
+  using mesh_simplify::Quadric;
+  std::vector<unsigned int> result(indices);
+  if (result_error) *result_error = 0.0f;
+  if (indices.size() <= target_index_count || vertices.empty()) return result;
+
+  // welded position of each vertex, and the vertices at each position
+  const std::size_t vertex_count = vertices.size();
+  std::vector<unsigned int> weld(vertex_count);
+  std::vector<std::vector<unsigned int>> welded_vertices;
+  {
+    // by the bits of the position, with -0 as 0
+    struct Key {
+      std::uint32_t bits[3];
+      bool operator==(const Key &o) const {
+        return bits[0] == o.bits[0] && bits[1] == o.bits[1] && bits[2] == o.bits[2];
+      }
+    };
+    struct Hash {
+      std::size_t operator()(const Key &k) const {
+        return (k.bits[0] * 73856093u) ^ (k.bits[1] * 19349663u) ^ (k.bits[2] * 83492791u);
+      }
+    };
+    std::unordered_map<Key, unsigned int, Hash> ids;
+    for (std::size_t v = 0; v < vertex_count; v++) {
+      const glm::vec3 p = vertices[v].Position + glm::vec3(0.0f);
+      Key key;
+      std::memcpy(key.bits, &p[0], sizeof(key.bits));
+      auto it = ids.emplace(key, static_cast<unsigned int>(welded_vertices.size())).first;
+      if (it->second == welded_vertices.size()) welded_vertices.emplace_back();
+      weld[v] = it->second;
+      welded_vertices[it->second].push_back(static_cast<unsigned int>(v));
+    }
+  }
+  const std::size_t welded_count = welded_vertices.size();
+  auto position = [&](unsigned int w) { return vertices[welded_vertices[w][0]].Position; };
+
+  // attribute differences cost as much as this fraction of the mesh size moved
+  glm::vec3 lo = vertices[0].Position, hi = lo;
+  for (auto &&v : vertices) {
+    lo = glm::min(lo, v.Position);
+    hi = glm::max(hi, v.Position);
+  }
+  const float extent = glm::length(hi - lo);
+  const double attribute_weight = (0.05 * extent) * (0.05 * extent);
+  auto attribute_distance = [&](unsigned int a, unsigned int b) {
+    glm::vec3 dn = vertices[a].Normal - vertices[b].Normal;
+    glm::vec2 dt = vertices[a].TexCoords - vertices[b].TexCoords;
+    return static_cast<double>(glm::dot(dn, dn) * 0.25f + glm::dot(dt, dt));
+  };
+  // the vertex at welded position w closest in attributes to v
+  auto closest = [&](unsigned int v, unsigned int w, double *distance) {
+    unsigned int best = welded_vertices[w][0];
+    double best_distance = attribute_distance(v, best);
+    for (unsigned int c : welded_vertices[w]) {
+      double d = attribute_distance(v, c);
+      if (d < best_distance) {
+        best_distance = d;
+        best = c;
+      }
+    }
+    if (distance) *distance = best_distance;
+    return best;
+  };
+
+  // plane quadrics, area weighted
+  std::vector<Quadric> quadrics(welded_count);
+  const std::size_t triangle_count = result.size() / 3;
+  for (std::size_t t = 0; t < triangle_count; t++) {
+    glm::vec3 p0 = vertices[result[t * 3]].Position;
+    glm::vec3 p1 = vertices[result[t * 3 + 1]].Position;
+    glm::vec3 p2 = vertices[result[t * 3 + 2]].Position;
+    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+    float area = glm::length(n);
+    if (!(area > 0.0f)) continue;
+    n /= area;
+    Quadric q = Quadric::FromPlane(n, -glm::dot(n, p0), area * 0.5);
+    for (int k = 0; k < 3; k++) quadrics[weld[result[t * 3 + k]]] += q;
+  }
+
+  std::vector<char> removed(triangle_count, 0);
+  std::size_t live_triangles = triangle_count;
+  const std::size_t target_triangles = target_index_count / 3;
+  double max_error = 0.0;
+  const double error_limit = static_cast<double>(target_error) * target_error;
+
+  struct Collapse {
+    unsigned int from, to;
+    double cost;
+  };
+  std::vector<std::vector<unsigned int>> adjacency(welded_count);
+  std::vector<char> locked(welded_count), touched(welded_count);
+  std::vector<Collapse> collapses;
+  std::vector<std::uint64_t> edge_keys;
+  std::vector<std::pair<std::uint64_t, unsigned int>> edges;  // with their triangle count
+
+  // passes of the cheapest independent collapses, until no collapse is left
+  while (live_triangles > target_triangles) {
+    for (auto &&a : adjacency) a.clear();
+    edge_keys.clear();
+    for (std::size_t t = 0; t < triangle_count; t++) {
+      if (removed[t]) continue;
+      for (int k = 0; k < 3; k++) {
+        unsigned int a = weld[result[t * 3 + k]], b = weld[result[t * 3 + (k + 1) % 3]];
+        adjacency[a].push_back(static_cast<unsigned int>(t));
+        edge_keys.push_back((static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b));
+      }
+    }
+    std::sort(edge_keys.begin(), edge_keys.end());
+    edges.clear();
+    for (auto &&key : edge_keys) {
+      if (edges.empty() || edges.back().first != key) edges.emplace_back(key, 0);
+      edges.back().second++;
+    }
+    // border and non-manifold edges lock their vertices
+    std::fill(locked.begin(), locked.end(), 0);
+    for (auto &&e : edges) {
+      if (e.second != 2) {
+        locked[e.first >> 32] = 1;
+        locked[e.first & 0xffffffffu] = 1;
+      }
+    }
+
+    collapses.clear();
+    for (auto &&e : edges) {
+      unsigned int a = static_cast<unsigned int>(e.first >> 32);
+      unsigned int b = static_cast<unsigned int>(e.first & 0xffffffffu);
+      if (a == b) continue;
+      for (int dir = 0; dir < 2; dir++) {
+        unsigned int from = dir ? b : a, to = dir ? a : b;
+        if (locked[from]) continue;
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        double cost = q.Error(position(to));
+        // corners moving to the other position take the closest attributes there
+        for (unsigned int t : adjacency[from]) {
+          for (int k = 0; k < 3; k++) {
+            unsigned int v = result[t * 3 + k];
+            if (weld[v] != from) continue;
+            double d;
+            closest(v, to, &d);
+            cost += attribute_weight * d;
+          }
+        }
+        collapses.push_back({from, to, cost});
+      }
+    }
+    if (collapses.empty()) break;
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+    std::fill(touched.begin(), touched.end(), 0);
+    std::size_t applied = 0;
+    for (auto &&c : collapses) {
+      if (live_triangles <= target_triangles) break;
+      if (touched[c.from] || touched[c.to]) continue;
+      Quadric q = quadrics[c.from];
+      q += quadrics[c.to];
+      double error = q.Error(position(c.to));
+      if (error > error_limit) continue;
+
+      // skip it if a remaining triangle would flip or collapse
+      bool flips = false;
+      glm::vec3 to = position(c.to);
+      for (unsigned int t : adjacency[c.from]) {
+        if (removed[t]) continue;
+        glm::vec3 p[3];
+        bool has_to = false;
+        for (int k = 0; k < 3; k++) {
+          unsigned int w = weld[result[t * 3 + k]];
+          has_to |= w == c.to;
+          p[k] = position(w);
+        }
+        if (has_to) continue;
+        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        for (int k = 0; k < 3; k++) {
+          if (weld[result[t * 3 + k]] == c.from) p[k] = to;
+        }
+        glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+        if (glm::dot(before, after) <= 0.0f) {
+          flips = true;
+          break;
+        }
+      }
+      if (flips) continue;
+
+      for (unsigned int t : adjacency[c.from]) {
+        if (removed[t]) continue;
+        bool has_to = false;
+        for (int k = 0; k < 3; k++) has_to |= weld[result[t * 3 + k]] == c.to;
+        if (has_to) {
+          removed[t] = 1;
+          live_triangles--;
+          continue;
+        }
+        for (int k = 0; k < 3; k++) {
+          unsigned int &v = result[t * 3 + k];
+          if (weld[v] == c.from) v = closest(v, c.to, nullptr);
+        }
+        adjacency[c.to].push_back(t);
+      }
+      quadrics[c.to] += quadrics[c.from];
+      adjacency[c.from].clear();
+      touched[c.from] = touched[c.to] = 1;
+      // the neighbours' costs are stale now
+      for (unsigned int t : adjacency[c.to]) {
+        for (int k = 0; k < 3; k++) touched[weld[result[t * 3 + k]]] = 1;
+      }
+      max_error = std::max(max_error, error);
+      applied++;
+    }
+    if (applied == 0) break;
+  }
+
+  std::size_t out = 0;
+  for (std::size_t t = 0; t < triangle_count; t++) {
+    if (removed[t]) continue;
+    for (int k = 0; k < 3; k++) result[out++] = result[t * 3 + k];
+  }
+  result.resize(out);
+  if (result_error) *result_error = static_cast<float>(std::sqrt(max_error));
+  return result;
+}
+
+// Appends up to kMaxMeshLods - 1 simplified levels to the indices, each about
+// half the triangles of the one before, until the simplifier stalls or a
+// level reaches kMeshLodMaxError of the bounds' diagonal, so the last level
+// keeps the shape. Levels are cache optimized. Returns all levels, the first
+// the original indices.
+template <typename V>
+std::vector<MeshLod> BuildLodChain(const std::vector<V> &vertices, std::vector<unsigned int> *indices) {
+  std::vector<MeshLod> lods;
+  lods.push_back({0, static_cast<std::uint32_t>(indices->size()), 0.0f});
+  if (indices->empty()) return lods;
+  glm::vec3 lo = vertices[(*indices)[0]].Position, hi = lo;
+  for (auto &&i : *indices) {
+    lo = glm::min(lo, vertices[i].Position);
+    hi = glm::max(hi, vertices[i].Position);
+  }
+  const float max_error = kMeshLodMaxError * glm::length(hi - lo);
+
+  std::vector<unsigned int> level(*indices);
+  float error = 0.0f;
+  while (static_cast<int>(lods.size()) < kMaxMeshLods && error < max_error) {
+    std::size_t target = level.size() / 2 / 3 * 3;
+    if (target < 3 * 16) break;
+    // the error of a level is against the full mesh, so the levels share the cap
+    float level_error = 0.0f;
+    std::vector<unsigned int> simplified = SimplifyMesh(vertices, level, target, max_error - error, &level_error);
+    if (simplified.size() > level.size() * 4 / 5) break;  // borders, seams or the cap is all that's left
+    error += level_error;
+    OptimizeVertexCache(simplified.data(), simplified.size(), vertices.size());
+    lods.push_back({static_cast<std::uint32_t>(indices->size()), static_cast<std::uint32_t>(simplified.size()), error});
+    indices->insert(indices->end(), simplified.begin(), simplified.end());
+    level.swap(simplified);
+    if (level.size() > target) break;  // stopped at the cap short of the target
+  }
+  return lods;
+}
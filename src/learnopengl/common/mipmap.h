@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIPMAP_SSE2 1
+#endif
+
+// CPU mip chain builder, so the levels could be made on the worker threads
+// decoding the image, and the GL thread only uploads them.
+//
+// kBox averages 2x2 texels, with SSE2 or AVX2 (as compiled for) on 8-bit
+// data. kKaiser is a separable Kaiser windowed sinc, sharper than the box.
+// sRGB images are filtered in linear space, alpha is always linear.
+enum class MipFilter {
+  kGpu,  // glGenerateMipmap(), nothing to build
+  kBox,
+  kKaiser,
+};
+
+struct MipLevel {
+  int width, height;
+  std::vector<unsigned char> data;  // tightly packed rows
+};
+
+namespace mipmap {
+
+inline const float *SrgbToLinearTable() {
+  static const std::vector<float> table = [] {
+    std::vector<float> t(256);
+    for (int i = 0; i < 256; i++) {
+      float c = i / 255.0f;
+      t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return t;
+  }();
+  return table.data();
+}
+
+inline unsigned char LinearToSrgb(float v) {
+  // 16-bit table over [0, 1], fine enough for the darks
+  static const std::vector<unsigned char> table = [] {
+    std::vector<unsigned char> t(65536);
+    for (int i = 0; i < 65536; i++) {
+      float c = i / 65535.0f;
+      float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1 / 2.4f) - 0.055f;
+      t[i] = static_cast<unsigned char>(std::min(255.0f, s * 255.0f + 0.5f));
+    }
+    return t;
+  }();
+  v = std::min(1.0f, std::max(0.0f, v));
+  return table[static_cast<int>(v * 65535.0f + 0.5f)];
+}
+
+inline unsigned char FloatToUnorm(float v) {
+  v = std::min(1.0f, std::max(0.0f, v));
+  return static_cast<unsigned char>(v * 255.0f + 0.5f);
+}
+
+// 2x2 box of 8-bit texels, the odd last row/column is clamped
+inline void BoxDownsample8(const unsigned char *src, int width, int height, int components,
+                           unsigned char *dst, int dst_width, int dst_height) {
+  const int c = components;
+  const std::size_t src_stride = static_cast<std::size_t>(width) * c;
+  std::vector<std::uint16_t> sum(static_cast<std::size_t>(width) * c);
+  for (int y = 0; y < dst_height; y++) {
+    const unsigned char *r0 = src + std::min(2 * y, height - 1) * src_stride;
+    const unsigned char *r1 = src + std::min(2 * y + 1, height - 1) * src_stride;
+
+    // vertical pair sums
+    std::size_t i = 0, n = src_stride;
+#if defined(__AVX2__)
+    for (; i + 16 <= n; i += 16) {
+      __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + i)));
+      __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + i)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(&sum[i]), _mm256_add_epi16(a, b));
+    }
+#elif defined(MIPMAP_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+      __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(r0 + i)), zero);
+      __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(r1 + i)), zero);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(&sum[i]), _mm_add_epi16(a, b));
+    }
+#endif
+    for (; i < n; i++) sum[i] = static_cast<std::uint16_t>(r0[i] + r1[i]);
+
+    // horizontal pair sums
+    unsigned char *out = dst + static_cast<std::size_t>(y) * dst_width * c;
+    int x = 0;
+#if defined(__AVX2__) || defined(MIPMAP_SSE2)
+    if (c == 4 && width >= 2) {
+      // two output texels from four input ones
+      const __m128i two = _mm_set1_epi16(2);
+      for (; x + 2 <= dst_width && 2 * x + 4 <= width; x += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&sum[8 * x]));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&sum[8 * x + 8]));
+        a = _mm_add_epi16(a, _mm_srli_si128(a, 8));
+        b = _mm_add_epi16(b, _mm_srli_si128(b, 8));
+        __m128i s = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(a, b), two), 2);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 4 * x), _mm_packus_epi16(s, s));
+      }
+    }
+#endif
+    for (; x < dst_width; x++) {
+      int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+      for (int k = 0; k < c; k++) {
+        out[x * c + k] = static_cast<unsigned char>((sum[x0 * c + k] + sum[x1 * c + k] + 2) / 4);
+      }
+    }
+  }
+}
+
+inline double BesselI0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+// taps of a 2:1 downsample, applied to source texels 2i + first .. 2i + first + n - 1
+struct Kernel {
+  int first;
+  std::vector<float> weights;
+};
+
+inline const Kernel &GetKernel(MipFilter filter) {
+  static const Kernel box{0, {0.5f, 0.5f}};
+  static const Kernel kaiser = [] {
+    const double pi = 3.14159265358979323846, alpha = 4.0, radius = 4.0;
+    Kernel k{-3, {}};
+    double total = 0;
+    for (int j = -3; j <= 4; j++) {
+      double d = j - 0.5;  // from the center of the destination texel, in source texels
+      double x = d / 2;
+      double sinc = std::sin(pi * x) / (pi * x);
+      double t = d / radius;
+      double window = BesselI0(alpha * std::sqrt(std::max(0.0, 1 - t * t))) / BesselI0(alpha);
+      k.weights.push_back(static_cast<float>(sinc * window));
+      total += sinc * window;
+    }
+    for (auto &&w : k.weights) w = static_cast<float>(w / total);
+    return k;
+  }();
+  return filter == MipFilter::kKaiser ? kaiser : box;
+}
+
+// dst += w * src, the inner loop of the vertical pass
+inline void MultiplyAdd(float *dst, const float *src, float w, std::size_t n) {
+  std::size_t i = 0;
+#if defined(__AVX2__)
+  __m256 vw = _mm256_set1_ps(w);
+  for (; i + 8 <= n; i += 8) {
+    __m256 d = _mm256_loadu_ps(dst + i);
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(d, _mm256_mul_ps(vw, _mm256_loadu_ps(src + i))));
+  }
+#elif defined(MIPMAP_SSE2)
+  __m128 vw = _mm_set1_ps(w);
+  for (; i + 4 <= n; i += 4) {
+    __m128 d = _mm_loadu_ps(dst + i);
+    _mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(vw, _mm_loadu_ps(src + i))));
+  }
+#endif
+  for (; i < n; i++) dst[i] += w * src[i];
+}
+
+// separable 2:1 downsample of float texels, an axis of size 1 is kept
+inline void Downsample(const std::vector<float> &src, int width, int height, int c,
+                       const Kernel &kernel, std::vector<float> *dst, int dst_width, int dst_height) {
+  // horizontal
+  std::vector<float> tmp(static_cast<std::size_t>(dst_width) * height * c, 0.0f);
+  for (int y = 0; y < height; y++) {
+    const float *row = &src[static_cast<std::size_t>(y) * width * c];
+    float *out = &tmp[static_cast<std::size_t>(y) * dst_width * c];
+    for (int x = 0; x < dst_width; x++) {
+      if (width == 1) {
+        for (int k = 0; k < c; k++) out[k] = row[k];
+        continue;
+      }
+      for (std::size_t t = 0; t < kernel.weights.size(); t++) {
+        int sx = std::min(std::max(2 * x + kernel.first + static_cast<int>(t), 0), width - 1);
+        for (int k = 0; k < c; k++) out[x * c + k] += kernel.weights[t] * row[sx * c + k];
+      }
+    }
+  }
+  // vertical
+  const std::size_t stride = static_cast<std::size_t>(dst_width) * c;
+  dst->assign(stride * dst_height, 0.0f);
+  for (int y = 0; y < dst_height; y++) {
+    float *out = &(*dst)[y * stride];
+    if (height == 1) {
+      std::memcpy(out, &tmp[0], stride * sizeof(float));
+      continue;
+    }
+    for (std::size_t t = 0; t < kernel.weights.size(); t++) {
+      int sy = std::min(std::max(2 * y + kernel.first + static_cast<int>(t), 0), height - 1);
+      MultiplyAdd(out, &tmp[sy * stride], kernel.weights[t], stride);
+    }
+  }
+}
+
+}  // namespace mipmap
+
+// Builds the levels after the base one, down to 1x1
+inline std::vector<MipLevel> BuildMipChain(const unsigned char *pixels, int width, int height,
+                                           int components, bool srgb, MipFilter filter) {
+  std::vector<MipLevel> levels;
+  if (filter == MipFilter::kGpu || pixels == nullptr || width <= 0 || height <= 0) return levels;
+  const int c = components;
+  // GL_SRGB only applies to RGB(A), alpha stays linear
+  const bool linearize = srgb && c >= 3;
+
+  if (filter == MipFilter::kBox && !linearize) {
+    const unsigned char *src = pixels;
+    int w = width, h = height;
+    while (w > 1 || h > 1) {
+      MipLevel level{std::max(1, w / 2), std::max(1, h / 2), {}};
+      level.data.resize(static_cast<std::size_t>(level.width) * level.height * c);
+      mipmap::BoxDownsample8(src, w, h, c, level.data.data(), level.width, level.height);
+      levels.push_back(std::move(level));
+      src = levels.back().data.data();
+      w = levels.back().width;
+      h = levels.back().height;
+    }
+    return levels;
+  }
+
+  // filter in float, from the previous float level to avoid requantizing
+  const float *to_linear = mipmap::SrgbToLinearTable();
+  std::vector<float> current(static_cast<std::size_t>(width) * height * c);
+  for (std::size_t i = 0; i < current.size(); i++) {
+    bool color = linearize && static_cast<int>(i % c) < 3;
+    current[i] = color ? to_linear[pixels[i]] : pixels[i] / 255.0f;
+  }
+  const mipmap::Kernel &kernel = mipmap::GetKernel(filter);
+  std::vector<float> next;
+  int w = width, h = height;
+  while (w > 1 || h > 1) {
+    MipLevel level{std::max(1, w / 2), std::max(1, h / 2), {}};
+    mipmap::Downsample(current, w, h, c, kernel, &next, level.width, level.height);
+    level.data.resize(next.size());
+    for (std::size_t i = 0; i < next.size(); i++) {
+      bool color = linearize && static_cast<int>(i % c) < 3;
+      level.data[i] = color ? mipmap::LinearToSrgb(next[i]) : mipmap::FloatToUnorm(next[i]);
+    }
+    levels.push_back(std::move(level));
+    current.swap(next);
+    w = levels.back().width;
+    h = levels.back().height;
+  }
+  return levels;
+}
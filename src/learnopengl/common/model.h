@@ -9,83 +9,418 @@
 
 #include <GL/glew.h>
 
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <future>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "base/render_queue.h"
+
+#include "draw_batch.h"
 #include "mesh.h"
+#include "mesh_cache.h"
 #include "shader.h"
-#include "stb_image_impl.h"
+#include "texture.h"
+#include "texture_array.h"
+#include "thread_pool.h"
 
 unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false);
+unsigned int TextureFromImage(const char *path, const Image &image, bool gamma = false);
+
+// we assume a convention for sampler names in the shaders. Each diffuse texture should be named
+// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
+// Same applies to other texture as the following list summarizes:
+// diffuse: texture_diffuseN
+// specular: texture_specularN
+// normal: texture_normalN
+static const std::pair<aiTextureType, const char *> kMaterialTextureTypes[] = {
+  {aiTextureType_DIFFUSE, "texture_diffuse"},        // 1. diffuse maps
+  {aiTextureType_SPECULAR, "texture_specular"},      // 2. specular maps
+  {aiTextureType_HEIGHT, "texture_normal"},          // 3. normal maps
+  {aiTextureType_AMBIENT, "texture_height"},         // 4. height maps
+  {aiTextureType_AMBIENT, "texture_reflection"},     // 5. reflection maps
+};
+
+// types packed by Model::PackTextures(), in the order of Mesh::texture_layers
+static const char *const kPackedTextureTypes[] = {
+  "texture_diffuse", "texture_specular", "texture_normal", "texture_height",
+};
 
 class Model {
  public:
   /*  Model Data */
-  std::vector<Texture> textures_loaded;  // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+  std::vector<Texture> textures_loaded;  // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once. they are owned by the TextureCache.
   std::vector<Mesh> meshes;
   std::string directory;
-  bool gammaCorrection;
+  bool gammaCorrection = false;
+  bool packedVertices = false;  // the meshes' buffers hold PackedVertex
 
   /*  Functions  */
   Model() = default;
-  explicit Model(std::string const &path, bool gamma = false) {
-    Create(path, gamma);
+  explicit Model(std::string const &path, bool gamma = false, bool packed = false) {
+    Create(path, gamma, packed);
+  }
+
+  // owns its meshes and textures, so it could only be moved
+  Model(const Model &) = delete;
+  Model &operator=(const Model &) = delete;
+
+  Model(Model &&other) noexcept
+    : textures_loaded(std::move(other.textures_loaded)),
+      meshes(std::move(other.meshes)),
+      directory(std::move(other.directory)),
+      gammaCorrection(other.gammaCorrection),
+      packedVertices(other.packedVertices),
+      textures_shared_(std::move(other.textures_shared_)),
+      textures_index_(std::move(other.textures_index_)),
+      texture_arrays_(std::move(other.texture_arrays_)) {
+    other.Release();
   }
 
-  void Create(std::string const &path, bool gamma = false) {
+  Model &operator=(Model &&other) noexcept {
+    if (this != &other) {
+      Release();
+      textures_loaded = std::move(other.textures_loaded);
+      meshes = std::move(other.meshes);
+      directory = std::move(other.directory);
+      gammaCorrection = other.gammaCorrection;
+      packedVertices = other.packedVertices;
+      textures_shared_ = std::move(other.textures_shared_);
+      textures_index_ = std::move(other.textures_index_);
+      texture_arrays_ = std::move(other.texture_arrays_);
+      other.Release();
+    }
+    return *this;
+  }
+
+  ~Model() {
+    Release();
+  }
+
+  // packed quantizes the vertices to PackedVertex, the shaders then decode
+  // them with PACKED_VERTEX_GLSL and the position_dequant uniform Draw() sets
+  void Create(std::string const &path, bool gamma = false, bool packed = false) {
+    Release();
     gammaCorrection = gamma;
+    packedVertices = packed;
     LoadModel(path);
   }
 
-  // draws the model, and thus all its meshes
-  void Draw(Shader shader) {
-    for (unsigned int i = 0; i < meshes.size(); i++)
-      meshes[i].Draw(shader);
+  // draws the model, and thus all its meshes. They share the VAO of their
+  // VertexPool chunk, which is only bound again when it changes. if the
+  // textures are packed and the shader samples the arrays, they're bound
+  // once for all meshes too.
+  void Draw(const Shader &shader) const {
+    bool packed = IsPacked() && BindTextureArrays(shader);
+    GLint layers = packed ? shader.GetUniformLocation(UNIFORM_ID("texture_layers")) : -1;
+    GLint dequant = packedVertices ? shader.GetUniformLocation(UNIFORM_ID("position_dequant")) : -1;
+    GLuint bound = 0;
+    for (auto &&mesh : meshes) {
+      if (dequant >= 0) glUniformMatrix4fv(dequant, 1, GL_FALSE, &mesh.position_dequant[0][0]);
+      if (packed) {
+        glUniform4iv(layers, 1, &mesh.texture_layers[0]);
+      } else {
+        mesh.BindTextures(shader);
+      }
+      if (mesh.VAO != bound) glBindVertexArray(bound = mesh.VAO);
+      mesh.DrawElements();
+    }
+    glBindVertexArray(0);
+    // always good practice to set everything back to defaults once configured.
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  // records the draws of the meshes into the queue instead, with the model
+  // uniform, depth its distance from the eye. The shader's other uniforms
+  // are set on it before RenderQueue::Execute(), as for Draw().
+  void Draw(const Shader &shader, RenderQueue *queue, const glm::mat4 &model,
+            float depth = 0.0f, std::uint32_t pass = 0) const {
+    RenderTexture arrays[4];
+    int array_count = IsPacked() ? GetTextureArrayBindings(shader, arrays) : 0;
+    GLint layers = array_count ? shader.GetUniformLocation(UNIFORM_ID("texture_layers")) : -1;
+    GLint dequant = packedVertices ? shader.GetUniformLocation(UNIFORM_ID("position_dequant")) : -1;
+    GLint model_location = shader.GetUniformLocation(UNIFORM_ID("model"));
+    for (auto &&mesh : meshes) {
+      std::uint32_t material = array_count ? arrays[0].id : mesh.MaterialId();
+      queue->Begin(RenderQueue::MakeKey(pass, false, shader.ID, material, mesh.VAO, depth),
+                   shader.ID, mesh.VAO, material);
+      queue->SetMat4(model_location, model);
+      if (dequant >= 0) queue->SetMat4(dequant, mesh.position_dequant);
+      if (array_count) {
+        for (int i = 0; i < array_count; i++) queue->BindTexture(arrays[i]);
+        queue->SetIVec4(layers, mesh.texture_layers);
+      } else {
+        mesh.RecordTextures(queue, shader);
+      }
+      mesh.RecordDrawElements(queue);
+    }
+  }
+
+  // Packs the first diffuse, specular, normal and height texture of each mesh
+  // into a GL_TEXTURE_2D_ARRAY per type, and sets Mesh::texture_layers.
+  // Draw() then binds the arrays once with shaders that sample them, e.g.
+  //   uniform sampler2DArray texture_diffuse_array;
+  //   uniform ivec4 texture_layers;  // diffuse, specular, normal, height
+  //   texture(texture_diffuse_array, vec3(TexCoords, texture_layers.x))
+  // false if some type can't be packed, Draw() then binds per mesh as before.
+  bool PackTextures() {
+    for (int type = 0; type < 4; type++) {
+      std::vector<GLuint> ids;
+      std::unordered_map<GLuint, int> layers;
+      for (auto &&mesh : meshes) {
+        mesh.texture_layers[type] = -1;
+        for (auto &&texture : mesh.textures) {
+          if (texture.type != kPackedTextureTypes[type]) continue;
+          auto it = layers.emplace(texture.id, static_cast<int>(ids.size())).first;
+          if (it->second == static_cast<int>(ids.size())) ids.push_back(texture.id);
+          mesh.texture_layers[type] = it->second;
+          break;
+        }
+      }
+      if (ids.empty()) {
+        texture_arrays_[type] = TextureArray();
+      } else if (!texture_arrays_[type].Pack(ids)) {
+        for (auto &&array : texture_arrays_) array = TextureArray();
+        return false;
+      }
+    }
+    return IsPacked();
+  }
+
+  // adds a draw per mesh to the batch, with the transform. DrawBatch::Draw()
+  // then draws all the models added at once, see BindTextureArrays() for
+  // the textures of a packed model.
+  void AddTo(DrawBatch *batch, const glm::mat4 &transform) const {
+    for (auto &&mesh : meshes) batch->Add(mesh, transform);
+  }
+
+  // binds the arrays the shader samples, false if it samples none
+  bool BindTextureArrays(const Shader &shader) const {
+    RenderTexture arrays[4];
+    int count = GetTextureArrayBindings(shader, arrays);
+    for (int i = 0; i < count; i++) {
+      glActiveTexture(GL_TEXTURE0 + arrays[i].unit);
+      glUniform1i(arrays[i].location, arrays[i].unit);
+      glBindTexture(arrays[i].target, arrays[i].id);
+    }
+    return count > 0;
+  }
+
+  // the arrays the shader samples, on units 0-3 by type, returns their count
+  int GetTextureArrayBindings(const Shader &shader, RenderTexture bindings[4]) const {
+    static const UniformId kSamplers[] = {
+      UNIFORM_ID("texture_diffuse_array"), UNIFORM_ID("texture_specular_array"),
+      UNIFORM_ID("texture_normal_array"), UNIFORM_ID("texture_height_array"),
+    };
+    int count = 0;
+    for (int type = 0; type < 4; type++) {
+      GLint location = shader.GetUniformLocation(kSamplers[type]);
+      if (location < 0 || !texture_arrays_[type].id()) continue;
+      bindings[count++] = {static_cast<GLuint>(type), GL_TEXTURE_2D_ARRAY, texture_arrays_[type].id(), location};
+    }
+    return count;
+  }
+
+  bool IsPacked() const {
+    for (auto &&array : texture_arrays_) {
+      if (array.id()) return true;
+    }
+    return false;
   }
 
  private:
   /*  Functions  */
+  // the textures are deleted once no other model shares them
+  void Release() {
+    for (auto &&array : texture_arrays_) array = TextureArray();
+    meshes.clear();
+    textures_loaded.clear();
+    textures_shared_.clear();
+    textures_index_.clear();
+  }
+
   // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+  // the imported meshes are cached as <path>.meshcache, later loads map it instead of importing again.
   void LoadModel(std::string const &path) {
+    // retrieve the directory path of the filepath
+    directory = path.substr(0, path.find_last_of('/'));
+
+    std::string cache_path = path + ".meshcache";
+    MeshCacheSource source;
+    bool cacheable = source.Read(path);
+    if (cacheable) {
+      MeshCacheFile cache;
+      if (cache.Open(cache_path, source, meshOptimizeFlags())) {
+        LoadMeshCache(cache);
+        printOptimizeStats(path);
+        return;
+      }
+    }
+
     // read file via ASSIMP
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
     // check for errors
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {  // if is Not Zero
       std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
       return;
     }
-    // retrieve the directory path of the filepath
-    directory = path.substr(0, path.find_last_of('/'));
 
-    // process ASSIMP's root node recursively
-    processNode(scene->mRootNode, scene);
+    // flatten ASSIMP's node tree into the list of meshes to load
+    std::vector<const aiMesh *> scene_meshes;
+    scene_meshes.reserve(scene->mNumMeshes);
+    processNode(scene->mRootNode, scene, &scene_meshes);
+
+    // 1. decode the material textures and convert the meshes to vertices/indices on the workers, they don't touch GL
+    std::vector<MaterialTexture> texture_refs;
+    for (auto &&mesh : scene_meshes) {
+      aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+      for (auto &&t : kMaterialTextureTypes) {
+        for (unsigned int i = 0; i < material->GetTextureCount(t.first); i++) {
+          aiString str;
+          material->GetTexture(t.first, i, &str);
+          texture_refs.push_back({str.C_Str(), t.second});
+        }
+      }
+    }
+    auto pending = decodeTextures(texture_refs);
+    std::vector<MeshData> data(scene_meshes.size());
+    ThreadPool::Instance().ParallelFor(scene_meshes.size(), [&](std::size_t i) {
+      processMesh(scene_meshes[i], &data[i]);
+    });
+    uploadTextures(&pending);
+
+    // 2. load the textures and create the buffers on the GL thread, in node order
+    meshes.reserve(data.size());
+    for (std::size_t i = 0; i < data.size(); i++) {
+      meshes.emplace_back(std::move(data[i].vertices), std::move(data[i].indices),
+                          processMaterial(scene->mMaterials[scene_meshes[i]->mMaterialIndex]),
+                          packedVertices);
+    }
+
+    for (std::size_t i = 0; i < meshes.size(); i++) {
+      meshes[i].optimize_stats = data[i].optimize_stats;
+      meshes[i].lods = std::move(data[i].lods);
+    }
+    printOptimizeStats(path);
+
+    if (cacheable) WriteMeshCache(cache_path, source, meshOptimizeFlags(), meshes);
+  }
+
+  // the ACMR/ATVR before and after the import passes, a line for the model
+  // with the ACMR weighted by triangles and the ATVR by vertices, and with
+  // MESH_OPTIMIZE_STATS=1 a line per mesh
+  void printOptimizeStats(const std::string &path) const {
+    const char *env = std::getenv("MESH_OPTIMIZE_STATS");
+    const bool per_mesh = env && std::strcmp(env, "1") == 0;
+    double acmr_source = 0, acmr_optimized = 0, atvr_source = 0, atvr_optimized = 0;
+    double triangles = 0, vertices = 0;
+    std::vector<std::size_t> lod_triangles;
+    for (std::size_t i = 0; i < meshes.size(); i++) {
+      const MeshOptimizeStats &stats = meshes[i].optimize_stats;
+      if (per_mesh) {
+        std::cout << "Model: " << path << " mesh " << i << " ACMR " << stats.source.acmr << " -> "
+                  << stats.optimized.acmr << ", ATVR " << stats.source.atvr << " -> " << stats.optimized.atvr
+                  << ", LOD triangles";
+        for (int lod = 0; lod < meshes[i].LodCount(); lod++) std::cout << " " << meshes[i].Lod(lod).index_count / 3;
+        std::cout << std::endl;
+      }
+      const double t = meshes[i].Lod(0).index_count / 3, v = meshes[i].allocation().vertex_count;
+      acmr_source += stats.source.acmr * t;
+      acmr_optimized += stats.optimized.acmr * t;
+      atvr_source += stats.source.atvr * v;
+      atvr_optimized += stats.optimized.atvr * v;
+      triangles += t;
+      vertices += v;
+      if (lod_triangles.size() < static_cast<std::size_t>(meshes[i].LodCount())) lod_triangles.resize(meshes[i].LodCount());
+      for (int lod = 0; lod < meshes[i].LodCount(); lod++) lod_triangles[lod] += meshes[i].Lod(lod).index_count / 3;
+    }
+    if (triangles > 0 && vertices > 0) {
+      std::cout << "Model: " << path << " " << meshes.size() << " meshes, ACMR " << acmr_source / triangles
+                << " -> " << acmr_optimized / triangles << ", ATVR " << atvr_source / vertices << " -> "
+                << atvr_optimized / vertices << ", LOD triangles";
+      for (auto &&count : lod_triangles) std::cout << " " << count;
+      std::cout << std::endl;
+    }
+  }
+
+  // creates the meshes from a mapped cache, the geometry goes to the GL buffers without a copy
+  void LoadMeshCache(const MeshCacheFile &cache) {
+    std::vector<MaterialTexture> texture_refs;
+    for (std::uint32_t i = 0; i < cache.mesh_count(); i++) {
+      const MeshCacheEntry &entry = cache.mesh(i);
+      for (std::uint32_t t = entry.first_texture; t < entry.first_texture + entry.texture_count; t++) {
+        texture_refs.push_back({cache.texture_path(t), cache.texture_type(t)});
+      }
+    }
+    auto pending = decodeTextures(texture_refs);
+    uploadTextures(&pending);
+
+    meshes.reserve(cache.mesh_count());
+    for (std::uint32_t i = 0; i < cache.mesh_count(); i++) {
+      const MeshCacheEntry &entry = cache.mesh(i);
+      std::vector<Texture> textures;
+      textures.reserve(entry.texture_count);
+      for (std::uint32_t j = 0; j < entry.texture_count; j++) {
+        std::uint32_t t = entry.first_texture + j;
+        textures.push_back(loadTexture(cache.texture_path(t), cache.texture_type(t)));
+      }
+      meshes.emplace_back(cache.vertices(entry), entry.vertex_count,
+                          cache.indices(entry), entry.index_count,
+                          std::move(textures), packedVertices);
+      meshes.back().optimize_stats = entry.optimize_stats;
+      meshes.back().lods = cache.lods(entry);
+    }
+  }
+
+  // CPU-side geometry of a mesh
+  struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    MeshOptimizeStats optimize_stats;
+    std::vector<MeshLod> lods;
+  };
+
+  // the import passes, MESH_OPTIMIZE=0 turns them off and MESH_OPTIMIZE=overdraw adds the overdraw one
+  static std::uint32_t meshOptimizeFlags() {
+    const char *env = std::getenv("MESH_OPTIMIZE");
+    if (env == nullptr) return kMeshOptimizeDefault;
+    if (std::strcmp(env, "0") == 0) return 0;
+    if (std::strcmp(env, "overdraw") == 0) return kMeshOptimizeDefault | kMeshOptimizeOverdraw;
+    return kMeshOptimizeDefault;
   }
 
-  // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-  void processNode(aiNode *node, const aiScene *scene) {
+  // processes a node in a recursive fashion. Collects each individual mesh located at the node and repeats this process on its children nodes (if any).
+  void processNode(const aiNode *node, const aiScene *scene, std::vector<const aiMesh *> *out) {
     // process each mesh located at the current node
     for (unsigned int i = 0; i < node->mNumMeshes; i++) {
       // the node object only contains indices to index the actual objects in the scene.
       // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-      aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-      meshes.push_back(processMesh(mesh, scene));
+      out->push_back(scene->mMeshes[node->mMeshes[i]]);
     }
     // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-      processNode(node->mChildren[i], scene);
+      processNode(node->mChildren[i], scene, out);
     }
   }
 
-  Mesh processMesh(aiMesh *mesh, const aiScene *scene) {
+  // converts the mesh on a worker thread, must not call GL
+  void processMesh(const aiMesh *mesh, MeshData *data) {
     // data to fill
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+    std::vector<Vertex> &vertices = data->vertices;
+    std::vector<unsigned int> &indices = data->indices;
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve(mesh->mNumFaces * 3);
 
     // Walk through each of the mesh's vertices
     for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
@@ -126,38 +461,34 @@ class Model {
     }
     // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
     for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-      aiFace face = mesh->mFaces[i];
+      const aiFace &face = mesh->mFaces[i];
       // retrieve all indices of the face and store them in the indices vector
       for (unsigned int j = 0; j < face.mNumIndices; j++)
         indices.push_back(face.mIndices[j]);
     }
-    // process materials
-    aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-    // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
-    // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
-    // Same applies to other texture as the following list summarizes:
-    // diffuse: texture_diffuseN
-    // specular: texture_specularN
-    // normal: texture_normalN
-
-    // 1. diffuse maps
-    std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-    // 2. specular maps
-    std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-    // 3. normal maps
-    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-    textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-    // 4. height maps
-    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-    textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-    // 5. reflection maps
-    std::vector<Texture> reflectionMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_reflection");
-    textures.insert(textures.end(), reflectionMaps.begin(), reflectionMaps.end());
-
-    // return a mesh object created from the extracted mesh data
-    return Mesh(vertices, indices, textures);
+
+    // reorder for the vertex cache, then the overdraw, then the vertex fetch
+    const std::uint32_t flags = meshOptimizeFlags();
+    data->optimize_stats.source = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    if (flags & kMeshOptimizeVertexCache) OptimizeVertexCache(indices.data(), indices.size(), vertices.size());
+    if (flags & kMeshOptimizeOverdraw) {
+      OptimizeOverdraw(indices.data(), indices.size(), vertices.size(),
+                       [&vertices](unsigned int v) { return vertices[v].Position; });
+    }
+    if (flags & kMeshOptimizeVertexFetch) OptimizeVertexFetch(&vertices, indices.data(), indices.size());
+    data->optimize_stats.optimized = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    // the simplified levels of detail go after the indices
+    if (flags & kMeshOptimizeLods) data->lods = BuildLodChain(vertices, &indices);
+  }
+
+  // loads the textures of the material on the GL thread
+  std::vector<Texture> processMaterial(aiMaterial *material) {
+    std::vector<Texture> textures;
+    for (auto &&t : kMaterialTextureTypes) {
+      std::vector<Texture> maps = loadMaterialTextures(material, t.first, t.second);
+      textures.insert(textures.end(), maps.begin(), maps.end());
+    }
+    return textures;
   }
 
   // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -167,64 +498,114 @@ class Model {
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
       aiString str;
       mat->GetTexture(type, i, &str);
-      // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-      bool skip = false;
-      for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-        if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-          textures.push_back(textures_loaded[j]);
-          skip = true;  // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-          break;
-        }
-      }
-      if (!skip) {
-        // if texture hasn't been loaded already, load it
-        Texture texture;
-        texture.id = TextureFromFile(str.C_Str(), this->directory);
-        texture.type = typeName;
-        texture.path = str.C_Str();
-        textures.push_back(texture);
-        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-      }
+      textures.push_back(loadTexture(str.C_Str(), typeName));
     }
     return textures;
   }
+
+  // texture referenced by a material
+  struct MaterialTexture {
+    std::string path;
+    std::string type;
+  };
+
+  // texture being decoded on a worker
+  struct PendingTexture {
+    MaterialTexture ref;
+    TextureCache::Key key;
+    std::future<Image> image;
+  };
+
+  // starts decoding the textures that aren't loaded yet, each once.
+  // the ones another model has loaded are shared through the TextureCache.
+  std::vector<PendingTexture> decodeTextures(const std::vector<MaterialTexture> &refs) {
+    std::vector<PendingTexture> pending;
+    std::unordered_set<std::string> queued;
+    for (auto &&ref : refs) {
+      if (textures_index_.count(ref.path) || !queued.insert(ref.path).second) continue;
+      std::string filename = directory + '/' + ref.path;
+      auto key = TextureCache::MakeKey(filename, modelTextureParams());
+      if (auto texture = TextureCache::Instance().Find(key)) {
+        addLoadedTexture(ref, texture);
+        continue;
+      }
+      // the mipmaps are built on the worker too
+      pending.push_back({ref, std::move(key), ThreadPool::Instance().Submit([filename]() {
+        return DecodeImage(filename.c_str(), modelTextureParams());
+      })});
+    }
+    return pending;
+  }
+
+  // uploads the decoded textures in order, only this part runs on the GL thread
+  void uploadTextures(std::vector<PendingTexture> *pending) {
+    for (auto &&p : *pending) {
+      GLuint id = TextureFromImage(p.ref.path.c_str(), p.image.get());
+      addLoadedTexture(p.ref, TextureCache::Instance().Insert(p.key, id));
+    }
+    pending->clear();
+  }
+
+  // loads the texture if it's not loaded yet
+  Texture loadTexture(const std::string &path, const std::string &typeName) {
+    // check if texture was loaded before and if so, skip loading a new texture
+    auto it = textures_index_.find(path);
+    if (it != textures_index_.end()) {
+      return textures_loaded[it->second];  // a texture with the same filepath has already been loaded. (optimization)
+    }
+    // if texture hasn't been loaded already by any model, load it
+    auto key = TextureCache::MakeKey(directory + '/' + path, modelTextureParams());
+    auto texture = TextureCache::Instance().Find(key);
+    if (!texture) {
+      texture = TextureCache::Instance().Insert(key, TextureFromFile(path.c_str(), this->directory));
+    }
+    return addLoadedTexture({path, typeName}, texture);
+  }
+
+  // stores it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+  const Texture &addLoadedTexture(const MaterialTexture &ref, const TexturePtr &shared) {
+    Texture texture;
+    texture.id = shared->id();
+    texture.type = ref.type;
+    texture.path = ref.path;
+    textures_index_.emplace(ref.path, textures_loaded.size());
+    textures_loaded.push_back(texture);
+    textures_shared_.push_back(shared);
+    return textures_loaded.back();
+  }
+
+  // params of the textures TextureFromFile() loads
+  static TextureParams modelTextureParams() {
+    TextureParams params;
+    params.wrap = GL_REPEAT;
+    return params;
+  }
+
+  // keeps the textures_loaded alive, they may be shared with other models
+  std::vector<TexturePtr> textures_shared_;
+  // index in textures_loaded by path
+  std::unordered_map<std::string, std::size_t> textures_index_;
+  // packed textures by kPackedTextureTypes
+  std::array<TextureArray, 4> texture_arrays_;
 };
 
 unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma) {
-  (void)gamma;
   std::string filename = std::string(path);
   filename = directory + '/' + filename;
+  TextureParams params;
+  params.wrap = GL_REPEAT;  // as Model::modelTextureParams()
+  return TextureFromImage(path, DecodeImage(filename.c_str(), params), gamma);
+}
+
+unsigned int TextureFromImage(const char *path, const Image &image, bool gamma) {
+  (void)gamma;
+  TextureParams params;
+  params.wrap = GL_REPEAT;  // as Model::modelTextureParams()
 
   unsigned int textureID;
   glGenTextures(1, &textureID);
-
-  int width, height, nrComponents;
-  unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-  if (data) {
-    GLenum format;
-    if (nrComponents == 1)        { format = GL_RED;
-    } else if (nrComponents == 3) { format = GL_RGB;
-    } else if (nrComponents == 4) { format = GL_RGBA;
-    } else {
-      std::cout << "Texture failed to load at path: " << path << std::endl;
-      stbi_image_free(data);
-      return textureID;
-    }
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    stbi_image_free(data);
-  } else {
+  if (!image.data || !UploadTexture(textureID, image, params)) {
     std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
   }
-
   return textureID;
 }
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "vertex_pool.h"
+
+// Vertex quantized to 20 bytes, for the bandwidth of many small meshes:
+//   position  unorm16 x4, xyz in the mesh bounds, w the bitangent sign (0 is -1)
+//   normal    snorm16 x2, octahedral
+//   tangent   snorm16 x2, octahedral
+//   texCoords half x2
+// The bitangent is rebuilt as cross(normal, tangent) * sign, and the position
+// by the mesh's dequantization matrix, see PACKED_VERTEX_GLSL.
+struct PackedVertex {
+  std::uint16_t position[4];
+  std::int16_t normal[2];
+  std::int16_t tangent[2];
+  std::uint16_t tex_coords[2];
+};
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex is 20 bytes");
+
+// attribute layout of PackedVertex, at the locations of Vertex's: position 0,
+// normal 1, texCoords 2, tangent 3 and none for the bitangent
+inline const VertexFormat &PackedVertexFormat() {
+  static const VertexFormat format{sizeof(PackedVertex), {
+    {0, 4, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position)},
+    {1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal)},
+    {2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, tex_coords)},
+    {3, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, tangent)},
+  }};
+  return format;
+}
+
+// GLSL decoding of the attributes, to put after the #version line, e.g.
+//   "#version 330 core\n" PACKED_VERTEX_GLSL R"vs(
+//     layout (location = 0) in vec4 aPos;
+//     layout (location = 1) in vec2 aNormal;
+//     uniform mat4 position_dequant;
+//     ...
+//     vec3 pos = DecodePosition(position_dequant, aPos);
+//     vec3 normal = DecodeOctahedral(aNormal);
+//   )vs"
+// A float Vertex reads the same with an identity position_dequant, as the
+// missing w of aPos is 1, but its normal is a vec3.
+#define PACKED_VERTEX_GLSL \
+  "vec3 DecodePosition(mat4 dequant, vec4 p) { return (dequant * vec4(p.xyz, 1.0)).xyz; }\n" \
+  "vec3 DecodeOctahedral(vec2 e) {\n" \
+  "  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n" \
+  "  float t = max(-n.z, 0.0);\n" \
+  "  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);\n" \
+  "  return normalize(n);\n" \
+  "}\n" \
+  "vec3 DecodeBitangent(vec3 normal, vec3 tangent, vec4 p) { return cross(normal, tangent) * (p.w * 2.0 - 1.0); }\n"
+
+namespace packed_vertex {
+
+inline std::int16_t Snorm16(float v) {
+  return static_cast<std::int16_t>(std::lround(std::max(-1.0f, std::min(1.0f, v)) * 32767.0f));
+}
+
+inline std::uint16_t Unorm16(float v) {
+  return static_cast<std::uint16_t>(std::lround(std::max(0.0f, std::min(1.0f, v)) * 65535.0f));
+}
+
+// octahedral mapping of a unit vector to [-1, 1]^2
+inline void EncodeOctahedral(const glm::vec3 &v, std::int16_t out[2]) {
+  float l1 = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+  if (l1 == 0.0f) {
+    out[0] = out[1] = 0;
+    return;
+  }
+  float x = v.x / l1, y = v.y / l1;
+  if (v.z < 0.0f) {
+    float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+    float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+    x = fx;
+    y = fy;
+  }
+  out[0] = Snorm16(x);
+  out[1] = Snorm16(y);
+}
+
+// IEEE half, rounded to nearest even
+inline std::uint16_t FloatToHalf(float f) {
+  std::uint32_t x;
+  std::memcpy(&x, &f, sizeof(x));
+  std::uint32_t sign = (x >> 16) & 0x8000;
+  std::uint32_t abs = x & 0x7fffffff;
+  if (abs >= 0x7f800000) {
+    return static_cast<std::uint16_t>(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));  // inf, nan
+  }
+  if (abs >= 0x477ff000) return static_cast<std::uint16_t>(sign | 0x7c00);  // overflows to inf
+  if (abs < 0x38800000) {
+    // subnormal, shift the mantissa with the implicit bit into place
+    if (abs < 0x33000000) return static_cast<std::uint16_t>(sign);
+    std::uint32_t e = abs >> 23;
+    std::uint32_t m = (abs & 0x7fffff) | 0x800000;
+    std::uint32_t shift = 126 - e;
+    std::uint32_t h = m >> shift;
+    std::uint32_t rest = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+    if (rest > half || (rest == half && (h & 1))) h++;
+    return static_cast<std::uint16_t>(sign | h);
+  }
+  std::uint32_t h = ((abs - 0x38000000) >> 13);
+  std::uint32_t rest = abs & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+  return static_cast<std::uint16_t>(sign | h);
+}
+
+}  // namespace packed_vertex
+
+// bounds of a mesh's positions, quantizing them to unorm16
+class PositionQuantization {
+ public:
+  void Add(const glm::vec3 &p) {
+    min_ = glm::min(min_, p);
+    max_ = glm::max(max_, p);
+  }
+
+  // maps the unorm [0, 1] positions back into the bounds
+  glm::mat4 Dequantization() const {
+    if (min_.x > max_.x) return glm::mat4(1.0f);
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), min_);
+    return glm::scale(m, Extent());
+  }
+
+  void Quantize(const glm::vec3 &p, std::uint16_t out[3]) const {
+    glm::vec3 extent = Extent();
+    for (int i = 0; i < 3; i++) out[i] = packed_vertex::Unorm16((p[i] - min_[i]) / extent[i]);
+  }
+
+ private:
+  // 1 for the flat axes, so they don't divide by 0
+  glm::vec3 Extent() const {
+    glm::vec3 extent = max_ - min_;
+    for (int i = 0; i < 3; i++) {
+      if (!(extent[i] > 0.0f)) extent[i] = 1.0f;
+    }
+    return extent;
+  }
+
+  glm::vec3 min_ = glm::vec3(INFINITY);
+  glm::vec3 max_ = glm::vec3(-INFINITY);
+};
+
+inline PackedVertex PackVertex(const PositionQuantization &quantization,
+                               const glm::vec3 &position, const glm::vec3 &normal,
+                               const glm::vec2 &tex_coords, const glm::vec3 &tangent,
+                               const glm::vec3 &bitangent) {
+  PackedVertex v;
+  quantization.Quantize(position, v.position);
+  v.position[3] = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? 0 : 65535;
+  packed_vertex::EncodeOctahedral(normal, v.normal);
+  packed_vertex::EncodeOctahedral(tangent, v.tangent);
+  v.tex_coords[0] = packed_vertex::FloatToHalf(tex_coords.x);
+  v.tex_coords[1] = packed_vertex::FloatToHalf(tex_coords.y);
+  return v;
+}
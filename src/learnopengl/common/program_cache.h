@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <sys/stat.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// On-disk cache of linked program binaries (glGetProgramBinary), keyed by a
+// hash of the shader sources plus the GL renderer and version.
+//
+// The directory is $SHADER_CACHE_DIR, or the user cache directory by default,
+// e.g. ~/.cache/start-opengl/shaders. An empty SHADER_CACHE_DIR disables it.
+class ProgramBinaryCache {
+ public:
+  static ProgramBinaryCache &Instance() {
+    // created on the first Shader::Create(), with a current context
+    static ProgramBinaryCache instance;
+    return instance;
+  }
+
+  bool IsEnabled() const { return enabled_; }
+
+  std::uint64_t Key(const char *vertex_shader_code,
+                    const char *fragment_shader_code,
+                    const char *geometry_shader_code = nullptr) const {
+    std::uint64_t hash = driver_hash_;
+    hash = Hash(vertex_shader_code, hash);
+    hash = Hash(fragment_shader_code, hash);
+    if (geometry_shader_code != nullptr)
+      hash = Hash(geometry_shader_code, hash);
+    return hash;
+  }
+
+  // of a compute program, tagged apart from the vertex/fragment ones
+  std::uint64_t ComputeKey(const char *compute_shader_code) const {
+    return Hash(compute_shader_code, Hash("compute", driver_hash_));
+  }
+
+  // Must be called before glLinkProgram() to make the binary retrievable
+  void PrepareLink(GLuint program) const {
+    if (!enabled_) return;
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
+  // Submits the cached binary, returns false if there is none. The driver
+  // may still reject it, check GL_LINK_STATUS and compile it again then.
+  bool Load(std::uint64_t key, GLuint program) const {
+    if (!enabled_) return false;
+    std::ifstream in(Path(key), std::ios::binary);
+    if (!in) return false;
+
+    Header header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        header.magic != kMagic || header.version != kVersion) {
+      return false;
+    }
+    // the rest of the file must be the binary, a corrupt length is a miss
+    const std::streamoff offset = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::streamoff size = in.tellg();
+    if (offset < 0 || size < offset || static_cast<std::uint64_t>(size - offset) != header.length ||
+        header.length == 0) {
+      return false;
+    }
+    in.seekg(offset);
+    std::vector<char> binary(header.length);
+    if (!in.read(binary.data(), binary.size())) return false;
+
+    glProgramBinary(program, header.format, binary.data(), header.length);
+    return true;
+  }
+
+  void Save(std::uint64_t key, GLuint program) const {
+    if (!enabled_) return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    Header header{kMagic, kVersion, 0, static_cast<std::uint32_t>(length)};
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+    header.format = format;
+
+    // write then rename, as other samples may read it at the same time
+    auto path = Path(key);
+    auto path_tmp = path + ".tmp";
+    {
+      std::ofstream out(path_tmp, std::ios::binary | std::ios::trunc);
+      if (!out) {
+        std::cout << "ERROR::PROGRAM_CACHE_WRITE: " << path_tmp << std::endl;
+        return;
+      }
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      out.write(binary.data(), binary.size());
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    std::rename(path_tmp.c_str(), path.c_str());
+  }
+
+ private:
+  struct Header {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t format;
+    std::uint32_t length;
+  };
+  static constexpr std::uint32_t kMagic = 0x42504c47;  // "GLPB"
+  static constexpr std::uint32_t kVersion = 1;
+
+  ProgramBinaryCache() : enabled_(false), driver_hash_(0) {
+    if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) return;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0) return;
+
+    dir_ = CacheDir();
+    if (dir_.empty() || !MakeDirs(dir_)) return;
+
+    driver_hash_ = Hash(reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+    driver_hash_ = Hash(reinterpret_cast<const char *>(glGetString(GL_VERSION)), driver_hash_);
+    enabled_ = true;
+  }
+
+  static std::uint64_t Hash(const char *s, std::uint64_t hash = 14695981039346656037ull) {
+    // FNV-1a, the terminator is hashed too to separate the sources
+    if (s == nullptr) s = "";
+    do {
+      hash ^= static_cast<unsigned char>(*s);
+      hash *= 1099511628211ull;
+    } while (*s++);
+    return hash;
+  }
+
+  static std::string CacheDir() {
+    const char *dir = std::getenv("SHADER_CACHE_DIR");
+    if (dir) return dir;  // empty disables the cache
+#ifdef _WIN32
+    const char *base = std::getenv("LOCALAPPDATA");
+    if (base) return std::string(base) + "/start-opengl/shaders";
+#else
+    const char *base = std::getenv("XDG_CACHE_HOME");
+    if (base && *base) return std::string(base) + "/start-opengl/shaders";
+    const char *home = std::getenv("HOME");
+    if (home && *home) return std::string(home) + "/.cache/start-opengl/shaders";
+#endif
+    return "";
+  }
+
+  static bool MakeDirs(const std::string &dir) {
+    for (auto pos = dir.find_first_of("/\\", 1); ;
+         pos = dir.find_first_of("/\\", pos + 1)) {
+      std::string sub = dir.substr(0, pos);
+#ifdef _WIN32
+      _mkdir(sub.c_str());
+#else
+      mkdir(sub.c_str(), 0755);
+#endif
+      if (pos == std::string::npos) break;
+    }
+#ifdef _WIN32
+    struct _stat st;
+    bool ok = _stat(dir.c_str(), &st) == 0;
+#else
+    struct stat st;
+    bool ok = stat(dir.c_str(), &st) == 0;
+#endif
+    if (!ok) std::cout << "ERROR::PROGRAM_CACHE_DIR: " << dir << std::endl;
+    return ok;
+  }
+
+  std::string Path(std::uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.bin",
+        static_cast<unsigned long long>(key));
+    return dir_ + name;
+  }
+
+  bool enabled_;
+  std::uint64_t driver_hash_;
+  std::string dir_;
+};
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 
+#include "program_cache.h"
+#include "uniform_table.h"
+
+class ShaderBatch;
+
 class Shader {
  public:
   GLuint ID;
@@ -17,98 +26,174 @@ class Shader {
     Create(vertex_shader_code, fragment_shader_code, geometry_shader_code);
   }
 
+  // Compiles and links at once, see ShaderBatch to compile several programs
   void Create(const char *vertex_shader_code,
               const char *fragment_shader_code,
-              const char *geometry_shader_code = nullptr) {
-    // vertex shader
-    int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertex_shader_code, NULL);
-    glCompileShader(vertexShader);
-    CheckCompileErrors(vertexShader, "VERTEX");
-
-    // fragment shader
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragment_shader_code, NULL);
-    glCompileShader(fragmentShader);
-    CheckCompileErrors(fragmentShader, "FRAGMENT");
-
-    // geometry shader
-    GLuint geometryShader = 0;
-    if (geometry_shader_code != nullptr) {
-      geometryShader = glCreateShader(GL_GEOMETRY_SHADER);
-      glShaderSource(geometryShader, 1, &geometry_shader_code, NULL);
-      glCompileShader(geometryShader);
-      CheckCompileErrors(geometryShader, "GEOMETRY");
-    }
+              const char *geometry_shader_code = nullptr);
+  // a compute program, needs GL 4.3, see IsComputeSupported()
+  void CreateCompute(const char *compute_shader_code);
 
-    // link shaders
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    if (geometry_shader_code != nullptr)
-      glAttachShader(shaderProgram, geometryShader);
-    glLinkProgram(shaderProgram);
-    CheckCompileErrors(shaderProgram, "PROGRAM");
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    if (geometry_shader_code != nullptr)
-      glDeleteShader(geometryShader);
-
-    ID = shaderProgram;
-  }
+  // the compute shaders here are #version 430, which the compute and storage
+  // buffer extensions on an older context don't make compile
+  static bool IsComputeSupported() { return GLEW_VERSION_4_3; }
 
   void Use() {
     glUseProgram(ID);
   }
 
-  void SetBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+  // Location resolved from the reflected table, -1 if not active
+  GLint GetUniformLocation(const char *name) const {
+    return uniforms_ ? uniforms_->Find(name) : -1;
   }
+  GLint GetUniformLocation(const UniformId &id) const {
+    return uniforms_ ? uniforms_->Find(id) : -1;
+  }
+
+  // unique per linked program, unlike ID that GL may reuse once a program
+  // is deleted, so it could key what is cached per program
+  std::uint64_t generation() const { return generation_; }
 
-  void SetInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+  void SetBool(const char *name, bool value) const {
+    SetBool(GetUniformLocation(name), value);
+  }
+  void SetBool(const UniformId &id, bool value) const {
+    SetBool(GetUniformLocation(id), value);
+  }
+  void SetBool(GLint location, bool value) const {
+    glUniform1i(location, (int)value);
   }
 
-  void SetFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+  void SetInt(const char *name, int value) const {
+    SetInt(GetUniformLocation(name), value);
+  }
+  void SetInt(const UniformId &id, int value) const {
+    SetInt(GetUniformLocation(id), value);
+  }
+  void SetInt(GLint location, int value) const {
+    glUniform1i(location, value);
   }
 
-  void SetVec2(const std::string &name, const glm::vec2 &value) const {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+  void SetFloat(const char *name, float value) const {
+    SetFloat(GetUniformLocation(name), value);
+  }
+  void SetFloat(const UniformId &id, float value) const {
+    SetFloat(GetUniformLocation(id), value);
   }
-  void SetVec2(const std::string &name, float x, float y) const {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+  void SetFloat(GLint location, float value) const {
+    glUniform1f(location, value);
   }
 
-  void SetVec3(const std::string &name, const glm::vec3 &value) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+  void SetVec2(const char *name, const glm::vec2 &value) const {
+    SetVec2(GetUniformLocation(name), value);
+  }
+  void SetVec2(const UniformId &id, const glm::vec2 &value) const {
+    SetVec2(GetUniformLocation(id), value);
+  }
+  void SetVec2(GLint location, const glm::vec2 &value) const {
+    glUniform2fv(location, 1, &value[0]);
+  }
+  void SetVec2(const char *name, float x, float y) const {
+    SetVec2(GetUniformLocation(name), x, y);
   }
-  void SetVec3(const std::string &name, float x, float y, float z) const {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+  void SetVec2(const UniformId &id, float x, float y) const {
+    SetVec2(GetUniformLocation(id), x, y);
+  }
+  void SetVec2(GLint location, float x, float y) const {
+    glUniform2f(location, x, y);
   }
 
-  void SetVec4(const std::string &name, const glm::vec4 &value) const {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+  void SetVec3(const char *name, const glm::vec3 &value) const {
+    SetVec3(GetUniformLocation(name), value);
+  }
+  void SetVec3(const UniformId &id, const glm::vec3 &value) const {
+    SetVec3(GetUniformLocation(id), value);
+  }
+  void SetVec3(GLint location, const glm::vec3 &value) const {
+    glUniform3fv(location, 1, &value[0]);
+  }
+  void SetVec3(const char *name, float x, float y, float z) const {
+    SetVec3(GetUniformLocation(name), x, y, z);
+  }
+  void SetVec3(const UniformId &id, float x, float y, float z) const {
+    SetVec3(GetUniformLocation(id), x, y, z);
   }
-  void SetVec4(const std::string &name, float x, float y, float z, float w) {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+  void SetVec3(GLint location, float x, float y, float z) const {
+    glUniform3f(location, x, y, z);
   }
 
-  void SetMat2(const std::string &name, const glm::mat2 &mat) const {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+  void SetVec4(const char *name, const glm::vec4 &value) const {
+    SetVec4(GetUniformLocation(name), value);
+  }
+  void SetVec4(const UniformId &id, const glm::vec4 &value) const {
+    SetVec4(GetUniformLocation(id), value);
+  }
+  void SetVec4(GLint location, const glm::vec4 &value) const {
+    glUniform4fv(location, 1, &value[0]);
+  }
+  void SetVec4(const char *name, float x, float y, float z, float w) const {
+    SetVec4(GetUniformLocation(name), x, y, z, w);
+  }
+  void SetVec4(const UniformId &id, float x, float y, float z, float w) const {
+    SetVec4(GetUniformLocation(id), x, y, z, w);
+  }
+  void SetVec4(GLint location, float x, float y, float z, float w) const {
+    glUniform4f(location, x, y, z, w);
   }
 
-  void SetMat3(const std::string &name, const glm::mat3 &mat) const {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+  void SetMat2(const char *name, const glm::mat2 &mat) const {
+    SetMat2(GetUniformLocation(name), mat);
+  }
+  void SetMat2(const UniformId &id, const glm::mat2 &mat) const {
+    SetMat2(GetUniformLocation(id), mat);
+  }
+  void SetMat2(GLint location, const glm::mat2 &mat) const {
+    glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+  }
+
+  void SetMat3(const char *name, const glm::mat3 &mat) const {
+    SetMat3(GetUniformLocation(name), mat);
+  }
+  void SetMat3(const UniformId &id, const glm::mat3 &mat) const {
+    SetMat3(GetUniformLocation(id), mat);
+  }
+  void SetMat3(GLint location, const glm::mat3 &mat) const {
+    glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
   }
 
-  void SetMat4(const std::string &name, const glm::mat4 &mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+  void SetMat4(const char *name, const glm::mat4 &mat) const {
+    SetMat4(GetUniformLocation(name), mat);
+  }
+  void SetMat4(const UniformId &id, const glm::mat4 &mat) const {
+    SetMat4(GetUniformLocation(id), mat);
+  }
+  void SetMat4(GLint location, const glm::mat4 &mat) const {
+    glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
   }
 
+  // typed by the value, e.g. Set(UNIFORM_ID("model"), model)
+  void Set(const UniformId &id, int value) const { SetInt(id, value); }
+  void Set(const UniformId &id, float value) const { SetFloat(id, value); }
+  void Set(const UniformId &id, const glm::vec2 &value) const { SetVec2(id, value); }
+  void Set(const UniformId &id, const glm::vec3 &value) const { SetVec3(id, value); }
+  void Set(const UniformId &id, const glm::vec4 &value) const { SetVec4(id, value); }
+  void Set(const UniformId &id, const glm::mat2 &value) const { SetMat2(id, value); }
+  void Set(const UniformId &id, const glm::mat3 &value) const { SetMat3(id, value); }
+  void Set(const UniformId &id, const glm::mat4 &value) const { SetMat4(id, value); }
+
  private:
-  void CheckCompileErrors(GLuint shader, std::string type) {
+  friend class ShaderBatch;
+
+  void SetProgram(GLuint program) {
+    static std::uint64_t generations = 0;
+    ID = program;
+    generation_ = ++generations;
+
+    // reflect active uniforms once, setters then never ask the driver
+    uniforms_ = std::make_shared<UniformTable>();
+    uniforms_->Reflect(ID);
+  }
+
+  static bool CheckCompileErrors(GLuint shader, std::string type) {
     GLint success;
     GLchar infoLog[1024];
     if (type != "PROGRAM") {
@@ -124,5 +209,214 @@ class Shader {
         std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
       }
     }
+    return success;
   }
+
+  // shared, as samples pass Shader by value
+  std::shared_ptr<UniformTable> uniforms_;
+  std::uint64_t generation_ = 0;
 };
+
+// Compiles several programs as a batch, e.g. all programs of a sample.
+//
+// Add() only submits the sources, or a cached program binary, to the driver.
+// Statuses are queried once in Finish(), so the driver could compile them
+// in parallel (KHR_parallel_shader_compile) while the caller loads assets:
+//
+//   ShaderBatch batch;
+//   batch.Add(&shader_a, vs, fs_a);
+//   batch.Add(&shader_b, vs, fs_b);
+//   ... load models, textures ...
+//   batch.Finish();  // shader_a.ID, shader_b.ID are valid from here
+class ShaderBatch {
+ public:
+  ShaderBatch() {
+    EnableDriverThreads();
+  }
+  ~ShaderBatch() {
+    Finish();
+  }
+
+  ShaderBatch(const ShaderBatch &) = delete;
+  ShaderBatch &operator=(const ShaderBatch &) = delete;
+
+  void Add(Shader *shader,
+           const char *vertex_shader_code,
+           const char *fragment_shader_code,
+           const char *geometry_shader_code = nullptr) {
+    Entry e;
+    e.shader = shader;
+    e.vertex_code = vertex_shader_code;
+    e.fragment_code = fragment_shader_code;
+    e.has_geometry = geometry_shader_code != nullptr;
+    if (e.has_geometry) e.geometry_code = geometry_shader_code;
+
+    // try the program binary of a previous run first
+    auto &cache = ProgramBinaryCache::Instance();
+    e.cache_key = cache.Key(vertex_shader_code, fragment_shader_code, geometry_shader_code);
+    e.program = glCreateProgram();
+    e.from_cache = cache.Load(e.cache_key, e.program);
+    if (!e.from_cache) Submit(&e);
+    entries_.push_back(std::move(e));
+  }
+
+  // a compute program, see Shader::IsComputeSupported()
+  void AddCompute(Shader *shader, const char *compute_shader_code) {
+    Entry e;
+    e.shader = shader;
+    e.compute_code = compute_shader_code;
+    e.has_geometry = false;
+    e.is_compute = true;
+
+    auto &cache = ProgramBinaryCache::Instance();
+    e.cache_key = cache.ComputeKey(compute_shader_code);
+    e.program = glCreateProgram();
+    e.from_cache = cache.Load(e.cache_key, e.program);
+    if (!e.from_cache) Submit(&e);
+    entries_.push_back(std::move(e));
+  }
+
+  // True once the driver completed every program, without blocking if
+  // KHR_parallel_shader_compile is supported
+  bool IsReady() const {
+    if (!EnableDriverThreads()) return true;
+#if defined(GL_COMPLETION_STATUS_KHR)
+    for (auto &&e : entries_) {
+      GLint completed = GL_FALSE;
+      glGetProgramiv(e.program, GL_COMPLETION_STATUS_KHR, &completed);
+      if (!completed) return false;
+    }
+#endif
+    return true;
+  }
+
+  // Checks every status, blocks until all programs are linked
+  void Finish() {
+    auto &cache = ProgramBinaryCache::Instance();
+    for (auto &&e : entries_) {
+      if (e.from_cache) {
+        GLint success = GL_FALSE;
+        glGetProgramiv(e.program, GL_LINK_STATUS, &success);
+        if (success) {
+          e.shader->SetProgram(e.program);
+          continue;
+        }
+        // rejected by the driver, e.g. after an update, compile it again
+        while (glGetError() != GL_NO_ERROR) {}
+        glDeleteProgram(e.program);
+        e.program = glCreateProgram();
+        Submit(&e);
+      }
+
+      if (e.is_compute) {
+        Shader::CheckCompileErrors(e.compute_shader, "COMPUTE");
+      } else {
+        Shader::CheckCompileErrors(e.vertex_shader, "VERTEX");
+        Shader::CheckCompileErrors(e.fragment_shader, "FRAGMENT");
+      }
+      if (e.has_geometry)
+        Shader::CheckCompileErrors(e.geometry_shader, "GEOMETRY");
+      if (Shader::CheckCompileErrors(e.program, "PROGRAM"))
+        cache.Save(e.cache_key, e.program);
+
+      if (e.is_compute) {
+        glDeleteShader(e.compute_shader);
+      } else {
+        glDeleteShader(e.vertex_shader);
+        glDeleteShader(e.fragment_shader);
+      }
+      if (e.has_geometry)
+        glDeleteShader(e.geometry_shader);
+
+      e.shader->SetProgram(e.program);
+    }
+    entries_.clear();
+  }
+
+ private:
+  struct Entry {
+    Shader *shader;
+    // copied, as a fallback compile may happen after the caller's scope
+    std::string vertex_code;
+    std::string fragment_code;
+    std::string geometry_code;
+    std::string compute_code;
+    bool has_geometry;
+    bool is_compute = false;
+
+    std::uint64_t cache_key;
+    bool from_cache;
+
+    GLuint vertex_shader = 0;
+    GLuint fragment_shader = 0;
+    GLuint geometry_shader = 0;
+    GLuint compute_shader = 0;
+    GLuint program = 0;
+  };
+
+  // Compiles and links without querying any status
+  static void Submit(Entry *e) {
+    if (e->is_compute) {
+      e->compute_shader = CompileShader(GL_COMPUTE_SHADER, e->compute_code);
+      glAttachShader(e->program, e->compute_shader);
+      ProgramBinaryCache::Instance().PrepareLink(e->program);
+      glLinkProgram(e->program);
+      return;
+    }
+    e->vertex_shader = CompileShader(GL_VERTEX_SHADER, e->vertex_code);
+    e->fragment_shader = CompileShader(GL_FRAGMENT_SHADER, e->fragment_code);
+    if (e->has_geometry)
+      e->geometry_shader = CompileShader(GL_GEOMETRY_SHADER, e->geometry_code);
+
+    glAttachShader(e->program, e->vertex_shader);
+    glAttachShader(e->program, e->fragment_shader);
+    if (e->has_geometry)
+      glAttachShader(e->program, e->geometry_shader);
+    ProgramBinaryCache::Instance().PrepareLink(e->program);
+    glLinkProgram(e->program);
+  }
+
+  static GLuint CompileShader(GLenum type, const std::string &code) {
+    GLuint shader = glCreateShader(type);
+    const char *source = code.c_str();
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    return shader;
+  }
+
+  // Lets the driver compile on its own threads, returns false if unsupported
+  static bool EnableDriverThreads() {
+    static const bool enabled = [] {
+#if defined(GL_KHR_parallel_shader_compile)
+      if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);  // implementation maximum
+        return true;
+      }
+#endif
+#if defined(GL_ARB_parallel_shader_compile)
+      if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+        return true;
+      }
+#endif
+      return false;
+    }();
+    return enabled;
+  }
+
+  std::vector<Entry> entries_;
+};
+
+inline void Shader::Create(const char *vertex_shader_code,
+                           const char *fragment_shader_code,
+                           const char *geometry_shader_code) {
+  ShaderBatch batch;
+  batch.Add(this, vertex_shader_code, fragment_shader_code, geometry_shader_code);
+  batch.Finish();
+}
+
+inline void Shader::CreateCompute(const char *compute_shader_code) {
+  ShaderBatch batch;
+  batch.AddCompute(this, compute_shader_code);
+  batch.Finish();
+}
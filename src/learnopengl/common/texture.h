@@ -6,84 +6,65 @@
 
 #include <GL/glew.h>
 
-#include "stb_image_impl.h"
+#include "compressed_texture.h"
+#include "image.h"
+#include "texture_cache.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+
+// loads a 2D texture from file, or shares the one already loaded with the same params
+// KTX2/DDS files are uploaded compressed, see CompressedTexturePath() for picking them instead of images.
+inline TexturePtr LoadSharedTexture(char const *path, const TextureParams &params = TextureParams()) {
+  std::string file = CompressedTexturePath(path);
+  auto key = TextureCache::MakeKey(file, params);
+  if (auto texture = TextureCache::Instance().Find(key)) return texture;
 
-// utility function for loading a 2D texture from file
-inline GLuint LoadTexture(char const *path) {
   GLuint textureID;
   glGenTextures(1, &textureID);
 
-  int width, height, nrComponents;
-  unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-  if (data) {
-    GLenum format;
-    if (nrComponents == 1)        { format = GL_RED;
-    } else if (nrComponents == 3) { format = GL_RGB;
-    } else if (nrComponents == 4) { format = GL_RGBA;
-    } else {
-      std::cout << "Texture failed to load at path: " << path << std::endl;
-      stbi_image_free(data);
-      return textureID;
-    }
-
+  if (IsCompressedTexturePath(file)) {
+    CompressedImage image;
     glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);  // for this tutorial: use GL_CLAMP_TO_EDGE to prevent semi-transparent borders. Due to interpolation it takes texels from next repeat
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (!LoadCompressedImage(file, &image) || !UploadCompressedImage(GL_TEXTURE_2D, image, params)) {
+      std::cout << "Texture failed to load at path: " << file << std::endl;
+    }
+    GLint wrap = params.wrap ? params.wrap : (CompressedHasAlpha(image.internal_format) ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.min_filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, params.mag_filter);
+    return TextureCache::Instance().Insert(key, textureID);
+  }
 
-    stbi_image_free(data);
-  } else {
+  Image image = DecodeImage(path, params);
+  if (!image.data || !UploadTexture(textureID, image, params)) {
     std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
   }
+  return TextureCache::Instance().Insert(key, textureID);
+}
 
-  return textureID;
+// utility function for loading a 2D texture from file, it's kept for the process
+inline GLuint LoadTexture(char const *path, const TextureParams &params) {
+  auto texture = LoadSharedTexture(path, params);
+  TextureCache::Instance().Pin(texture);
+  return texture->id();
 }
 
 // utility function for loading a 2D texture from file
-inline GLuint LoadTexture(char const *path, bool gamma_correction) {
-  GLuint textureID;
-  glGenTextures(1, &textureID);
-
-  int width, height, nrComponents;
-  unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-  if (data) {
-    GLenum internalFormat;
-    GLenum dataFormat;
-    if (nrComponents == 1)        {
-      internalFormat = dataFormat = GL_RED;
-    } else if (nrComponents == 3) {
-      internalFormat = gamma_correction ? GL_SRGB : GL_RGB;
-      dataFormat = GL_RGB;
-    } else if (nrComponents == 4) {
-      internalFormat = gamma_correction ? GL_SRGB_ALPHA : GL_RGBA;
-      dataFormat = GL_RGBA;
-    } else {
-      std::cout << "Texture failed to load at path: " << path << std::endl;
-      stbi_image_free(data);
-      return textureID;
-    }
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, dataFormat, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, dataFormat == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, dataFormat == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+inline GLuint LoadTexture(char const *path) {
+  return LoadTexture(path, TextureParams());
+}
 
-    stbi_image_free(data);
-  } else {
-    std::cout << "Texture failed to load at path: " << path << std::endl;
-    stbi_image_free(data);
-  }
+// utility function for loading a 2D texture from file. if streaming, it's a
+// placeholder until TextureStreamer::Instance().Update() has uploaded it.
+inline GLuint LoadTexture(char const *path, bool gamma_correction, bool streaming = false) {
+  TextureParams params;
+  params.srgb = gamma_correction;
+  if (!streaming) return LoadTexture(path, params);
 
-  return textureID;
+  auto texture = TextureStreamer::Instance().Load(path, params);
+  TextureCache::Instance().Pin(texture);
+  return texture->id();
 }
 
 // loads a cubemap texture from 6 individual texture faces
@@ -94,20 +75,41 @@ inline GLuint LoadTexture(char const *path, bool gamma_correction) {
 // -Y (bottom)
 // +Z (front)
 // -Z (back)
-inline GLuint LoadCubemap(const std::vector<std::string> &faces) {
+// a single KTX2/DDS cubemap file could be given instead of the faces.
+inline TexturePtr LoadSharedCubemap(const std::vector<std::string> &faces) {
+  std::vector<std::string> files(faces.size());
+  for (std::size_t i = 0; i < faces.size(); i++) files[i] = CompressedTexturePath(faces[i]);
+  auto key = TextureCache::MakeKey(files);
+  if (auto texture = TextureCache::Instance().Find(key)) return texture;
+
   GLuint textureID;
   glGenTextures(1, &textureID);
   glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-  int width, height, nrChannels;
-  for (unsigned int i = 0; i < faces.size(); i++) {
-    unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-      stbi_image_free(data);
+  // decode the faces concurrently, then upload them here
+  std::vector<Image> images(files.size());
+  std::vector<CompressedImage> compressed_images(files.size());
+  std::vector<char> compressed_ok(files.size(), 0);
+  ThreadPool::Instance().ParallelFor(files.size(), [&](std::size_t i) {
+    if (IsCompressedTexturePath(files[i])) {
+      compressed_ok[i] = LoadCompressedImage(files[i], &compressed_images[i]);
+    } else {
+      images[i].Decode(files[i].c_str());
+    }
+  });
+  for (unsigned int i = 0; i < files.size(); i++) {
+    const Image &image = images[i];
+    if (IsCompressedTexturePath(files[i])) {
+      const CompressedImage &compressed_image = compressed_images[i];
+      if (!compressed_ok[i] || (files.size() == 1 && compressed_image.faces != 6) ||
+          !UploadCompressedImage(GL_TEXTURE_CUBE_MAP, compressed_image, TextureParams(),
+                                 GL_TEXTURE_CUBE_MAP_POSITIVE_X + i)) {
+        std::cout << "Cubemap texture failed to load at path: " << files[i] << std::endl;
+      }
+    } else if (image.data) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.data);
     } else {
       std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-      stbi_image_free(data);
     }
   }
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -116,5 +118,12 @@ inline GLuint LoadCubemap(const std::vector<std::string> &faces) {
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-  return textureID;
+  return TextureCache::Instance().Insert(key, textureID);
+}
+
+// loads a cubemap texture, it's kept for the process
+inline GLuint LoadCubemap(const std::vector<std::string> &faces) {
+  auto texture = LoadSharedCubemap(faces);
+  TextureCache::Instance().Pin(texture);
+  return texture->id();
 }
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <GL/glew.h>
+
+// 2D textures packed as the layers of a GL_TEXTURE_2D_ARRAY, so the meshes
+// using any of them share one binding and pick theirs by the layer index.
+//
+// The array takes the size and format most of the textures have. Those are
+// copied with glCopyImageSubData (GL 4.3 or ARB_copy_image), the others are
+// scaled into their layer by glBlitFramebuffer, which compressed ones can't.
+// Must be used on the GL thread.
+class TextureArray {
+ public:
+  TextureArray() = default;
+
+  TextureArray(const TextureArray &) = delete;
+  TextureArray &operator=(const TextureArray &) = delete;
+
+  TextureArray(TextureArray &&other) noexcept
+    : id_(other.id_), layers_(other.layers_) {
+    other.id_ = 0;
+    other.layers_ = 0;
+  }
+  TextureArray &operator=(TextureArray &&other) noexcept {
+    if (this != &other) {
+      Release();
+      id_ = other.id_;
+      layers_ = other.layers_;
+      other.id_ = 0;
+      other.layers_ = 0;
+    }
+    return *this;
+  }
+
+  ~TextureArray() { Release(); }
+
+  // packs the textures, textures[i] into layer i. false if they can't be,
+  // leaving the array empty. The source textures are left as they are.
+  bool Pack(const std::vector<GLuint> &textures) {
+    Release();
+    if (textures.empty()) return false;
+    if (!(GLEW_VERSION_3_0 || GLEW_EXT_texture_array)) return false;
+
+    GLint last_texture = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+    std::vector<Source> sources(textures.size());
+    for (std::size_t i = 0; i < textures.size(); i++) sources[i] = Describe(textures[i]);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+
+    // the most common size and format
+    std::map<std::tuple<GLint, GLint, GLint>, int> counts;
+    for (auto &&s : sources) counts[std::make_tuple(s.width, s.height, s.internal_format)]++;
+    auto common = std::max_element(counts.begin(), counts.end(),
+        [](const std::pair<const std::tuple<GLint, GLint, GLint>, int> &a,
+           const std::pair<const std::tuple<GLint, GLint, GLint>, int> &b) { return a.second < b.second; });
+    GLint width, height, internal_format;
+    std::tie(width, height, internal_format) = common->first;
+    int levels = MipLevels(width, height);
+    bool compressed = false;
+    for (auto &&s : sources) {
+      if (s.width == width && s.height == height && s.internal_format == internal_format) {
+        levels = std::min(levels, s.levels);
+        compressed = s.compressed;
+      } else if (s.compressed) {
+        std::cout << "TextureArray: can't scale compressed texture " << s.id << std::endl;
+        return false;
+      }
+    }
+    const bool copy_image = GLEW_VERSION_4_3 || GLEW_ARB_copy_image;
+    if (compressed && !copy_image) return false;
+
+    // the errors before aren't ours
+    while (glGetError() != GL_NO_ERROR) {
+    }
+    GLint last_array = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &last_array);
+    glGenTextures(1, &id_);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id_);
+    const GLsizei layers = static_cast<GLsizei>(textures.size());
+    if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage) {
+      glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, internal_format, width, height, layers);
+    } else if (!compressed) {
+      for (int level = 0; level < levels; level++) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internal_format, std::max(1, width >> level),
+                     std::max(1, height >> level), layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      }
+    } else {
+      glBindTexture(GL_TEXTURE_2D_ARRAY, last_array);
+      Release();
+      return false;
+    }
+    if (glGetError() != GL_NO_ERROR) {
+      std::cout << "TextureArray: can't allocate format " << internal_format << std::endl;
+      glBindTexture(GL_TEXTURE_2D_ARRAY, last_array);
+      Release();
+      return false;
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    // sampled as the first texture is
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, sources[0].wrap_s);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, sources[0].wrap_t);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, sources[0].min_filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, sources[0].mag_filter);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, last_array);
+
+    GLint last_read = 0, last_draw = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &last_read);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &last_draw);
+    GLuint fbos[2] = {0, 0};
+    bool ok = true;
+    for (GLsizei layer = 0; layer < layers && ok; layer++) {
+      const Source &s = sources[layer];
+      bool same = s.width == width && s.height == height && s.internal_format == internal_format;
+      for (int level = 0; level < levels && ok; level++) {
+        GLint w = std::max(1, width >> level), h = std::max(1, height >> level);
+        if (same && copy_image) {
+          glCopyImageSubData(s.id, GL_TEXTURE_2D, level, 0, 0, 0,
+                             id_, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1);
+          continue;
+        }
+        // the source level closest above the destination one
+        int src_level = same ? level : SourceLevel(s, w, h);
+        if (fbos[0] == 0) glGenFramebuffers(2, fbos);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbos[0]);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, s.id, src_level);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[1]);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, id_, level, layer);
+        if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE ||
+            glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+          ok = false;
+          break;
+        }
+        GLint sw = std::max(1, s.width >> src_level), sh = std::max(1, s.height >> src_level);
+        glBlitFramebuffer(0, 0, sw, sh, 0, 0, w, h, GL_COLOR_BUFFER_BIT,
+                          sw == w && sh == h ? GL_NEAREST : GL_LINEAR);
+      }
+    }
+    if (fbos[0]) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, last_read);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, last_draw);
+      glDeleteFramebuffers(2, fbos);
+    }
+    // a copy between incompatible formats fails without a status to check
+    if (glGetError() != GL_NO_ERROR) ok = false;
+    if (!ok) {
+      std::cout << "TextureArray: failed to copy the textures" << std::endl;
+      Release();
+      return false;
+    }
+    layers_ = layers;
+    return true;
+  }
+
+  GLuint id() const { return id_; }
+  int layers() const { return layers_; }
+
+ private:
+  struct Source {
+    GLuint id;
+    GLint width, height, internal_format;
+    bool compressed;
+    int levels;
+    GLint wrap_s, wrap_t, min_filter, mag_filter;
+  };
+
+  static int MipLevels(int width, int height) {
+    int levels = 1;
+    while ((width | height) >> levels) levels++;
+    return levels;
+  }
+
+  // binds it to GL_TEXTURE_2D to query it
+  static Source Describe(GLuint id) {
+    Source s;
+    s.id = id;
+    glBindTexture(GL_TEXTURE_2D, id);
+    GLint compressed = 0, max_level = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &s.width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &s.height);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &s.internal_format);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &max_level);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &s.wrap_s);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &s.wrap_t);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &s.min_filter);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &s.mag_filter);
+    s.compressed = compressed != 0;
+    s.internal_format = SizedFormat(s.internal_format);
+    s.levels = std::min(MipLevels(s.width, s.height), max_level + 1);
+    if (s.min_filter == GL_LINEAR || s.min_filter == GL_NEAREST) s.levels = 1;
+    return s;
+  }
+
+  // the sized format of an unsized one, as glTexImage2D was given and some
+  // drivers (Mesa) report back, which glTexStorage3D rejects
+  static GLint SizedFormat(GLint internal_format) {
+    switch (internal_format) {
+      case GL_RED: return GL_R8;
+      case GL_RG: return GL_RG8;
+      case GL_RGB: return GL_RGB8;
+      case GL_RGBA: return GL_RGBA8;
+      case GL_SRGB: return GL_SRGB8;
+      case GL_SRGB_ALPHA: return GL_SRGB8_ALPHA8;
+      default: return internal_format;
+    }
+  }
+
+  static int SourceLevel(const Source &s, GLint width, GLint height) {
+    int level = 0;
+    while (level + 1 < s.levels && (s.width >> (level + 1)) >= width &&
+           (s.height >> (level + 1)) >= height) {
+      level++;
+    }
+    return level;
+  }
+
+  void Release() {
+    if (id_) glDeleteTextures(1, &id_);
+    id_ = 0;
+    layers_ = 0;
+  }
+
+  GLuint id_ = 0;
+  int layers_ = 0;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "mipmap.h"
+
+// how an image is uploaded and sampled
+struct TextureParams {
+  bool srgb = false;
+  // GL_CLAMP_TO_EDGE for images with alpha and GL_REPEAT else, if 0
+  GLint wrap = 0;
+  GLint min_filter = GL_LINEAR_MIPMAP_LINEAR;
+  GLint mag_filter = GL_LINEAR;
+  // how the mipmaps are made, on the CPU while decoding unless kGpu
+  MipFilter mip_filter = MipFilter::kBox;
+};
+
+// GL texture shared through the TextureCache, deleted with its last reference
+class SharedTexture {
+ public:
+  explicit SharedTexture(GLuint id) : id_(id) {}
+  ~SharedTexture() {
+    if (id_) glDeleteTextures(1, &id_);
+  }
+
+  SharedTexture(const SharedTexture &) = delete;
+  SharedTexture &operator=(const SharedTexture &) = delete;
+
+  GLuint id() const { return id_; }
+
+ private:
+  GLuint id_;
+};
+
+using TexturePtr = std::shared_ptr<const SharedTexture>;
+
+// absolute path with links and dots resolved, the path itself if it doesn't exist
+inline std::string CanonicalPath(const std::string &path) {
+#ifdef _WIN32
+  char buf[_MAX_PATH];
+  if (_fullpath(buf, path.c_str(), sizeof(buf))) return buf;
+#else
+  char buf[PATH_MAX];
+  if (realpath(path.c_str(), buf)) return buf;
+#endif
+  return path;
+}
+
+// Process-wide cache of the textures loaded from files, keyed by the canonical
+// path, the target and the upload/sampler parameters. It only holds weak
+// references, a texture is deleted once no Model or caller uses it.
+//
+// Must be used on the GL thread.
+class TextureCache {
+ public:
+  static TextureCache &Instance() {
+    // never destroyed, as the pinned textures may outlive the context
+    static TextureCache *instance = new TextureCache();
+    return *instance;
+  }
+
+  struct Key {
+    std::string path;  // canonical, the faces joined by '\n' for a cubemap
+    GLenum target;
+    bool srgb;
+    GLint wrap, min_filter, mag_filter;
+    MipFilter mip_filter;
+
+    bool operator==(const Key &o) const {
+      return target == o.target && srgb == o.srgb && wrap == o.wrap &&
+          min_filter == o.min_filter && mag_filter == o.mag_filter &&
+          mip_filter == o.mip_filter && path == o.path;
+    }
+  };
+
+  static Key MakeKey(const std::string &path, const TextureParams &params,
+                     GLenum target = GL_TEXTURE_2D) {
+    return Key{CanonicalPath(path), target, params.srgb,
+               params.wrap, params.min_filter, params.mag_filter, params.mip_filter};
+  }
+  static Key MakeKey(const std::vector<std::string> &faces,
+                     GLenum target = GL_TEXTURE_CUBE_MAP) {
+    std::string path;
+    for (auto &&face : faces) {
+      if (!path.empty()) path += '\n';
+      path += CanonicalPath(face);
+    }
+    return Key{path, target, false, 0, 0, 0, MipFilter::kGpu};
+  }
+
+  // the live texture of the key, nullptr if none
+  TexturePtr Find(const Key &key) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return nullptr;
+    TexturePtr texture = it->second.lock();
+    if (!texture) entries_.erase(it);
+    return texture;
+  }
+
+  // takes ownership of the texture id and caches it under the key
+  TexturePtr Insert(const Key &key, GLuint id) {
+    TexturePtr texture = std::make_shared<SharedTexture>(id);
+    entries_[key] = texture;
+    if (++inserts_ % 64 == 0) Prune();
+    return texture;
+  }
+
+  // keeps the texture alive for the process, for the callers that only take a raw id
+  void Pin(const TexturePtr &texture) {
+    for (auto &&pinned : pinned_) {
+      if (pinned == texture) return;
+    }
+    pinned_.push_back(texture);
+  }
+
+  std::size_t size() const { return entries_.size(); }
+
+ private:
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const {
+      std::size_t h = std::hash<std::string>()(key.path);
+      for (std::uint64_t v : {std::uint64_t(key.target), std::uint64_t(key.srgb),
+                              std::uint64_t(key.wrap), std::uint64_t(key.min_filter),
+                              std::uint64_t(key.mag_filter), std::uint64_t(key.mip_filter)}) {
+        h ^= std::hash<std::uint64_t>()(v) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+      }
+      return h;
+    }
+  };
+
+  TextureCache() = default;
+
+  // drops the entries of the textures already deleted
+  void Prune() {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      if (it->second.expired()) {
+        it = entries_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  std::unordered_map<Key, std::weak_ptr<const SharedTexture>, KeyHash> entries_;
+  std::vector<TexturePtr> pinned_;
+  std::size_t inserts_ = 0;
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <list>
+#include <string>
+#include <utility>
+
+#include <GL/glew.h>
+
+#include "image.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+// Streams 2D textures in the background. Load() returns at once a texture
+// holding a 1x1 placeholder, the image is decoded and its mipmaps are built
+// on the ThreadPool, then
+// Update() copies it into a ring of GL_PIXEL_UNPACK_BUFFERs and the driver
+// uploads it from there without blocking the GL thread. A fence per buffer
+// tells when it could be written again.
+//
+// The buffers are persistently mapped with GL 4.4 or ARB_buffer_storage, and
+// orphaned on each upload otherwise. Must be used on the GL thread, with
+// Update() called once per frame.
+class TextureStreamer {
+ public:
+  static TextureStreamer &Instance() {
+    // never destroyed, as the TextureCache
+    static TextureStreamer *instance = new TextureStreamer();
+    return *instance;
+  }
+
+  TexturePtr Load(const char *path, const TextureParams &params = TextureParams()) {
+    auto key = TextureCache::MakeKey(path, params);
+    if (auto texture = TextureCache::Instance().Find(key)) return texture;
+
+    GLint last_texture = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    static const unsigned char kPlaceholder[4] = {128, 128, 128, 255};
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, kPlaceholder);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+
+    auto texture = TextureCache::Instance().Insert(key, textureID);
+    std::string filename(path);
+    jobs_.push_back({texture, params, filename,
+        ThreadPool::Instance().Submit([filename, params]() {
+          return DecodeImage(filename.c_str(), params);
+        })});
+    return texture;
+  }
+
+  // Uploads the decoded images, up to budget bytes but at least one image per
+  // call. Returns the number of textures still streaming.
+  std::size_t Update(std::size_t budget = 16 << 20) {
+    if (jobs_.empty()) return 0;
+
+    GLint last_texture = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
+
+    std::size_t uploaded = 0;
+    for (auto it = jobs_.begin(); it != jobs_.end() && (uploaded == 0 || uploaded < budget);) {
+      if (it->image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        ++it;
+        continue;
+      }
+      if (it->texture.use_count() == 1) {  // nobody uses it anymore
+        it = jobs_.erase(it);
+        continue;
+      }
+      Slot *slot = AcquireSlot();
+      if (slot == nullptr) break;  // all buffers are in flight
+
+      Image image = it->image.get();
+      if (!image.data || !Upload(slot, image, it->texture->id(), it->params)) {
+        std::cout << "Texture failed to load at path: " << it->path << std::endl;
+      } else {
+        uploaded += image.PackedSize();
+      }
+      it = jobs_.erase(it);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, last_texture);
+    return jobs_.size();
+  }
+
+  bool IsIdle() const { return jobs_.empty(); }
+
+ private:
+  static constexpr int kSlotCount = 4;
+
+  struct Job {
+    TexturePtr texture;
+    TextureParams params;
+    std::string path;
+    std::future<Image> image;
+  };
+
+  struct Slot {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+    std::size_t capacity = 0;
+    void *mapped = nullptr;  // persistent mapping
+  };
+
+  TextureStreamer()
+    : persistent_(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage), next_(0) {
+    for (auto &&slot : slots_) glGenBuffers(1, &slot.buffer);
+  }
+
+  // next buffer the GPU has finished reading, nullptr if none
+  Slot *AcquireSlot() {
+    for (int i = 0; i < kSlotCount; i++) {
+      Slot &slot = slots_[(next_ + i) % kSlotCount];
+      if (slot.fence) {
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+      }
+      next_ = (next_ + i + 1) % kSlotCount;
+      return &slot;
+    }
+    return nullptr;
+  }
+
+  bool Upload(Slot *slot, const Image &image, GLuint textureID, const TextureParams &params) {
+    // all the levels, one after another
+    std::size_t size = image.PackedSize();
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+    if (persistent_) {
+      if (slot->capacity < size) {
+        // storage is immutable, so grow by replacing the buffer
+        glDeleteBuffers(1, &slot->buffer);
+        glGenBuffers(1, &slot->buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot->buffer);
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+        slot->mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        slot->capacity = size;
+      }
+      if (slot->mapped == nullptr) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+      }
+      image.PackLevels(slot->mapped);
+    } else {
+      // orphan the storage, the driver hands out a new one if still in use
+      if (slot->capacity < size) slot->capacity = size;
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, slot->capacity, nullptr, GL_STREAM_DRAW);
+      void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+      if (mapped == nullptr) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+      }
+      image.PackLevels(mapped);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    bool ok = UploadTexture(textureID, image, params, true);
+
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return ok;
+  }
+
+  bool persistent_;
+  Slot slots_[kSlotCount];
+  int next_;
+  std::list<Job> jobs_;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fixed pool of worker threads for CPU-side loading work. The tasks must not
+// call GL, which belongs to the thread owning the context.
+class ThreadPool {
+ public:
+  // shared by the loaders, one worker per core
+  static ThreadPool &Instance() {
+    static ThreadPool instance(std::max(1u, std::thread::hardware_concurrency()));
+    return instance;
+  }
+
+  explicit ThreadPool(unsigned int thread_count) : stop_(false) {
+    workers_.reserve(thread_count);
+    for (unsigned int i = 0; i < thread_count; i++) {
+      workers_.emplace_back([this]() { Work(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto &&worker : workers_) worker.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  std::size_t size() const { return workers_.size(); }
+
+  template <typename F>
+  auto Submit(F &&f) -> std::future<decltype(f())> {
+    using R = decltype(f());
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace([task]() { (*task)(); });
+    }
+    cond_.notify_one();
+    return future;
+  }
+
+  // Calls f(i) for i in [0, count) and waits for all. The calling thread
+  // takes part too, the indices are handed out one by one.
+  template <typename F>
+  void ParallelFor(std::size_t count, F &&f) {
+    if (count == 0) return;
+    auto next = std::make_shared<std::atomic<std::size_t>>(0);
+    auto run = [next, count, &f]() {
+      for (std::size_t i = (*next)++; i < count; i = (*next)++) f(i);
+    };
+    std::size_t helpers = std::min(workers_.size(), count - 1);
+    std::vector<std::future<void>> futures;
+    futures.reserve(helpers);
+    for (std::size_t i = 0; i < helpers; i++) futures.push_back(Submit(run));
+    run();
+    for (auto &&future : futures) future.get();
+  }
+
+ private:
+  void Work() {
+    for (;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+        if (stop_ && tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+// 64-bit FNV-1a hash of a uniform name
+constexpr std::uint64_t HashUniformName(const char *name) {
+  std::uint64_t hash = 14695981039346656037ull;
+  while (*name) {
+    hash ^= static_cast<unsigned char>(*name++);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+struct UniformId {
+  std::uint64_t hash;
+  const char *name;  // for the debug collision check
+};
+
+// Uniform handle hashed at compile time from a string literal, e.g.
+//   shader.SetMat4(UNIFORM_ID("projection"), projection);
+// The hash is a template argument, so the compiler evaluates it even in debug
+// builds, and a lookup is a probe of the reflected table without hashing,
+// allocation or driver call. A name that isn't a constant doesn't compile.
+#define UNIFORM_ID(name) (UniformId{std::integral_constant<std::uint64_t, HashUniformName(name)>::value, (name)})
+
+// Active uniforms of a linked program, reflected once into a flat open
+// addressing table keyed by the name hash. Lookups never call the driver.
+class UniformTable {
+ public:
+  UniformTable() = default;
+
+  void Reflect(GLuint program) {
+    std::vector<std::pair<std::string, GLint>> uniforms;
+
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<GLchar> buf(max_length > 0 ? max_length : 1);
+    for (GLint i = 0; i < count; i++) {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(program, i, buf.size(), &length, &size, &type, buf.data());
+      std::string name(buf.data(), length);
+      GLint location = glGetUniformLocation(program, name.c_str());
+      if (location < 0) continue;  // member of a uniform block
+      uniforms.emplace_back(name, location);
+
+      // arrays are reported as "name[0]", also map "name" and every "name[i]"
+      auto n = name.size();
+      if (size > 1 || (n > 3 && name.compare(n - 3, 3, "[0]") == 0)) {
+        std::string base = name.substr(0, name.find_last_of('['));
+        uniforms.emplace_back(base, location);
+        for (GLint j = 1; j < size; j++) {
+          std::string element = base + "[" + std::to_string(j) + "]";
+          uniforms.emplace_back(element,
+              glGetUniformLocation(program, element.c_str()));
+        }
+      }
+    }
+
+    std::size_t capacity = 8;
+    while (capacity < uniforms.size() * 2) capacity <<= 1;
+    entries_.assign(capacity, Entry{0, -1});
+    mask_ = capacity - 1;
+#ifndef NDEBUG
+    names_.assign(capacity, std::string());
+#endif
+    for (auto &&u : uniforms) {
+      Insert(u.first, u.second);
+    }
+    size_ = uniforms.size();
+  }
+
+  // Location of the uniform, -1 if not active as glGetUniformLocation
+  GLint Find(std::uint64_t hash) const {
+    if (entries_.empty()) return -1;
+    for (std::size_t i = hash & mask_; ; i = (i + 1) & mask_) {
+      const Entry &e = entries_[i];
+      if (e.hash == hash) return e.location;
+      if (e.hash == 0) return -1;
+    }
+  }
+  GLint Find(const char *name) const {
+    return Find(HashUniformName(name));
+  }
+  GLint Find(const UniformId &id) const {
+#ifndef NDEBUG
+    // an inactive name may hash like an active one
+    if (!entries_.empty()) {
+      std::size_t i = id.hash & mask_;
+      while (entries_[i].hash != 0 && entries_[i].hash != id.hash) {
+        i = (i + 1) & mask_;
+      }
+      if (entries_[i].hash == id.hash && names_[i] != id.name) {
+        std::cerr << "ERROR::UNIFORM_HASH_COLLISION: " << id.name
+            << " vs " << names_[i] << std::endl;
+      }
+    }
+#endif
+    return Find(id.hash);
+  }
+
+  std::size_t size() const { return size_; }
+
+ private:
+  struct Entry {
+    std::uint64_t hash;  // 0 marks an empty slot
+    GLint location;
+  };
+
+  void Insert(const std::string &name, GLint location) {
+    std::uint64_t hash = HashUniformName(name.c_str());
+    for (std::size_t i = hash & mask_; ; i = (i + 1) & mask_) {
+      Entry &e = entries_[i];
+      if (e.hash == 0 || e.hash == hash) {
+#ifndef NDEBUG
+        if (e.hash == hash && names_[i] != name) {
+          std::cerr << "ERROR::UNIFORM_HASH_COLLISION: " << name
+              << " vs " << names_[i] << std::endl;
+        }
+        names_[i] = name;
+#endif
+        e.hash = hash;
+        e.location = location;
+        return;
+      }
+    }
+  }
+
+  std::vector<Entry> entries_;
+#ifndef NDEBUG
+  std::vector<std::string> names_;  // parallel to entries_
+#endif
+  std::size_t mask_ = 0;
+  std::size_t size_ = 0;
+};
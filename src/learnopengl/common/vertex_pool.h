@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+
+// vertex attribute of a VertexFormat, as glVertexAttribPointer takes it
+struct VertexAttrib {
+  GLuint index;
+  GLint size;
+  GLenum type;
+  GLboolean normalized;
+  std::size_t offset;
+
+  bool operator==(const VertexAttrib &o) const {
+    return index == o.index && size == o.size && type == o.type &&
+        normalized == o.normalized && offset == o.offset;
+  }
+};
+
+// interleaved layout of a vertex
+struct VertexFormat {
+  GLsizei stride;
+  std::vector<VertexAttrib> attribs;
+
+  bool operator==(const VertexFormat &o) const {
+    return stride == o.stride && attribs == o.attribs;
+  }
+
+  // sets the attribute pointers of the bound VAO into the bound GL_ARRAY_BUFFER
+  void Apply() const {
+    for (auto &&a : attribs) {
+      glEnableVertexAttribArray(a.index);
+      glVertexAttribPointer(a.index, a.size, a.type, a.normalized, stride, reinterpret_cast<void *>(a.offset));
+    }
+  }
+};
+
+// Megabuffer of the meshes of one vertex format. Chunks of one VBO, one EBO
+// and a VAO over both are suballocated through free lists, so a mesh is a
+// {base vertex, first index, count} range, and the meshes of a chunk draw
+// under one VAO with glDrawElementsBaseVertex.
+//
+// A chunk is never reallocated, so the ranges and the VAOs built over its
+// buffers stay valid. A new chunk is added when none has room. Must be used
+// on the GL thread.
+class VertexPool {
+ public:
+  static constexpr GLuint kChunkVertices = 1 << 18;
+  static constexpr GLuint kChunkIndices = 1 << 20;
+
+  // range of a mesh, indices are 32-bit
+  struct Allocation {
+    int chunk = -1;
+    GLuint first_vertex = 0, vertex_count = 0;
+    GLuint first_index = 0, index_count = 0;
+    // added to the indices when drawing, 0 if they're already rebased
+    GLint base_vertex = 0;
+    GLuint vao = 0;
+
+    bool valid() const { return chunk >= 0; }
+    // byte offset of the first index, for the draw calls
+    const void *indices() const {
+      return reinterpret_cast<const void *>(static_cast<std::size_t>(first_index) * sizeof(GLuint));
+    }
+  };
+
+  // the pool of the format, created on first use and never destroyed, as
+  // the meshes may outlive the context
+  static VertexPool &ForFormat(const VertexFormat &format) {
+    static std::vector<VertexPool *> *pools = new std::vector<VertexPool *>();
+    for (auto &&pool : *pools) {
+      if (pool->format_ == format) return *pool;
+    }
+    pools->push_back(new VertexPool(format));
+    return *pools->back();
+  }
+
+  // copies the geometry into the first chunk with room for it
+  Allocation Allocate(const void *vertices, std::size_t vertex_count,
+                      const GLuint *indices, std::size_t index_count) {
+    Allocation a;
+    a.vertex_count = static_cast<GLuint>(vertex_count);
+    a.index_count = static_cast<GLuint>(index_count);
+    for (std::size_t i = 0; i <= chunks_.size() && !a.valid(); i++) {
+      if (i == chunks_.size()) {
+        chunks_.emplace_back(new Chunk(format_, std::max(kChunkVertices, a.vertex_count),
+                                       std::max(kChunkIndices, a.index_count)));
+      }
+      Chunk &chunk = *chunks_[i];
+      if (!chunk.vertices.Allocate(a.vertex_count, &a.first_vertex)) continue;
+      if (!chunk.indices.Allocate(a.index_count, &a.first_index)) {
+        chunk.vertices.Free(a.first_vertex, a.vertex_count);
+        continue;
+      }
+      a.chunk = static_cast<int>(i);
+      a.vao = chunk.vao;
+    }
+
+    const Chunk &chunk = *chunks_[a.chunk];
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(a.first_vertex) * format_.stride,
+                    static_cast<GLsizeiptr>(vertex_count) * format_.stride, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    const GLintptr index_offset = static_cast<GLintptr>(a.first_index) * sizeof(GLuint);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, chunk.ebo);
+    if (base_vertex_) {
+      a.base_vertex = static_cast<GLint>(a.first_vertex);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, index_offset, index_count * sizeof(GLuint), indices);
+    } else {
+      // without glDrawElementsBaseVertex the indices carry the base
+      std::vector<GLuint> rebased(indices, indices + index_count);
+      for (auto &&index : rebased) index += a.first_vertex;
+      glBufferSubData(GL_COPY_WRITE_BUFFER, index_offset, index_count * sizeof(GLuint), rebased.data());
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return a;
+  }
+
+  void Free(const Allocation &a) {
+    if (!a.valid()) return;
+    Chunk &chunk = *chunks_[a.chunk];
+    chunk.vertices.Free(a.first_vertex, a.vertex_count);
+    chunk.indices.Free(a.first_index, a.index_count);
+  }
+
+  // a new VAO over the buffers of the allocation's chunk, with the format's
+  // attributes and the EBO bound, e.g. to add instanced attributes. Owned by
+  // the caller, valid as long as the pool is.
+  GLuint CreateVertexArray(const Allocation &a) const {
+    return chunks_[a.chunk]->CreateVertexArray(format_);
+  }
+
+  // draws the range, its chunk's VAO or one from CreateVertexArray() must be bound
+  void DrawElements(const Allocation &a, GLsizei instances = 1) const {
+    if (base_vertex_) {
+      if (instances == 1) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, a.index_count, GL_UNSIGNED_INT, a.indices(), a.base_vertex);
+      } else {
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, a.index_count, GL_UNSIGNED_INT, a.indices(),
+                                          instances, a.base_vertex);
+      }
+    } else if (instances == 1) {
+      glDrawElements(GL_TRIANGLES, a.index_count, GL_UNSIGNED_INT, a.indices());
+    } else {
+      glDrawElementsInstanced(GL_TRIANGLES, a.index_count, GL_UNSIGNED_INT, a.indices(), instances);
+    }
+  }
+
+  const VertexFormat &format() const { return format_; }
+  bool has_base_vertex() const { return base_vertex_; }
+  std::size_t chunk_count() const { return chunks_.size(); }
+
+ private:
+  // first fit free list of [offset, offset + size) ranges, coalesced on free
+  class FreeList {
+   public:
+    explicit FreeList(GLuint capacity) { free_[0] = capacity; }
+
+    bool Allocate(GLuint size, GLuint *offset) {
+      for (auto it = free_.begin(); it != free_.end(); ++it) {
+        if (it->second < size) continue;
+        *offset = it->first;
+        GLuint rest = it->second - size;
+        free_.erase(it);
+        if (rest) free_[*offset + size] = rest;
+        return true;
+      }
+      return false;
+    }
+
+    void Free(GLuint offset, GLuint size) {
+      if (size == 0) return;
+      auto it = free_.emplace(offset, size).first;
+      auto next = std::next(it);
+      if (next != free_.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        free_.erase(next);
+      }
+      if (it != free_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+          prev->second += it->second;
+          free_.erase(it);
+        }
+      }
+    }
+
+   private:
+    std::map<GLuint, GLuint> free_;
+  };
+
+  struct Chunk {
+    GLuint vbo = 0, ebo = 0, vao = 0;
+    FreeList vertices, indices;
+
+    Chunk(const VertexFormat &format, GLuint vertex_capacity, GLuint index_capacity)
+      : vertices(vertex_capacity), indices(index_capacity) {
+      glGenBuffers(1, &vbo);
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertex_capacity) * format.stride,
+                   nullptr, GL_STATIC_DRAW);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      glGenBuffers(1, &ebo);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+      glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(index_capacity) * sizeof(GLuint),
+                   nullptr, GL_STATIC_DRAW);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      vao = CreateVertexArray(format);
+    }
+
+    GLuint CreateVertexArray(const VertexFormat &format) const {
+      GLuint array;
+      glGenVertexArrays(1, &array);
+      glBindVertexArray(array);
+      glBindBuffer(GL_ARRAY_BUFFER, vbo);
+      format.Apply();
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+      glBindVertexArray(0);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      return array;
+    }
+  };
+
+  explicit VertexPool(const VertexFormat &format)
+    : format_(format),
+      base_vertex_(GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex) {}
+
+  VertexFormat format_;
+  bool base_vertex_;
+  std::vector<std::unique_ptr<Chunk>> chunks_;
+};
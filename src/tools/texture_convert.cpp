@@ -0,0 +1,200 @@
+// Converts images into BC compressed KTX2 files with full mip chains, which
+// LoadTexture() and LoadCubemap() pick instead if TEXTURE_COMPRESSED=1.
+//
+//   texture_convert [options] <image|dir>...
+//     -o <dir>        output directory, beside the image by default
+//     --format <f>    auto (default), bc1, bc3, bc4 or bc5
+//     --flip          flip vertically, for the samples that load flipped
+//     --mips <f>      mip filter, box (default) or kaiser
+//
+// auto is bc4 for 1, bc5 for 2, bc1 for 3 and bc3 for 4 component images.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "common/compressed_texture.h"
+#include "common/mipmap.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+namespace {
+
+struct Options {
+  std::string out_dir;
+  std::string format = "auto";
+  bool flip = false;
+  MipFilter mip_filter = MipFilter::kBox;
+};
+
+bool IsImage(const std::string &path) {
+  for (const char *ext : {".png", ".jpg", ".jpeg", ".tga", ".bmp"}) {
+    if (compressed::EndsWith(path, ext)) return true;
+  }
+  return false;
+}
+
+// images in the directory and its subdirectories
+void ListImages(const std::string &dir, std::vector<std::string> *out) {
+#ifdef _WIN32
+  _finddata_t data;
+  intptr_t handle = _findfirst((dir + "/*").c_str(), &data);
+  if (handle == -1) return;
+  do {
+    std::string name = data.name;
+    if (name == "." || name == "..") continue;
+    std::string path = dir + "/" + name;
+    if (data.attrib & _A_SUBDIR) {
+      ListImages(path, out);
+    } else if (IsImage(path)) {
+      out->push_back(path);
+    }
+  } while (_findnext(handle, &data) == 0);
+  _findclose(handle);
+#else
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) return;
+  while (dirent *entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") continue;
+    std::string path = dir + "/" + name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) continue;
+    if (S_ISDIR(st.st_mode)) {
+      ListImages(path, out);
+    } else if (IsImage(path)) {
+      out->push_back(path);
+    }
+  }
+  closedir(d);
+#endif
+}
+
+bool IsDir(const std::string &path) {
+#ifdef _WIN32
+  _finddata_t data;
+  intptr_t handle = _findfirst(path.c_str(), &data);
+  if (handle == -1) return false;
+  _findclose(handle);
+  return (data.attrib & _A_SUBDIR) != 0;
+#else
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+bool Convert(const std::string &path, const Options &options) {
+  int width, height, components;
+  stbi_set_flip_vertically_on_load(options.flip);
+  stbi_uc *data = stbi_load(path.c_str(), &width, &height, &components, 4);
+  if (data == nullptr) {
+    std::cerr << "Failed to load " << path << std::endl;
+    return false;
+  }
+  std::vector<std::uint8_t> rgba(data, data + static_cast<std::size_t>(width) * height * 4);
+  stbi_image_free(data);
+
+  std::string format = options.format;
+  if (format == "auto") {
+    static const char *kAuto[] = {"bc4", "bc4", "bc5", "bc1", "bc3"};
+    format = kAuto[components];
+  }
+  BlockFormat block_format;
+  std::uint32_t vk_format;
+  if (format == "bc1") {
+    block_format = BlockFormat::kBC1, vk_format = 131;
+  } else if (format == "bc3") {
+    block_format = BlockFormat::kBC3, vk_format = 137;
+  } else if (format == "bc4") {
+    block_format = BlockFormat::kBC4, vk_format = 139;
+  } else if (format == "bc5") {
+    if (components == 2) {  // grey + alpha, as loaded to rgba
+      for (std::size_t i = 0; i < rgba.size(); i += 4) rgba[i + 1] = rgba[i + 3];
+    }
+    block_format = BlockFormat::kBC5, vk_format = 141;
+  } else {
+    std::cerr << "Unknown format " << format << std::endl;
+    return false;
+  }
+
+  std::vector<MipLevel> mips = BuildMipChain(rgba.data(), width, height, 4, false, options.mip_filter);
+  mips.insert(mips.begin(), MipLevel{width, height, std::move(rgba)});
+  std::vector<std::vector<std::vector<std::uint8_t>>> levels;
+  for (auto &&mip : mips) {
+    std::vector<std::uint8_t> blocks(BlockImageBytes(block_format, mip.width, mip.height));
+    EncodeBlocks(block_format, mip.data.data(), mip.width, mip.height, blocks.data());
+    levels.push_back({std::move(blocks)});
+  }
+
+  std::string out = path.substr(0, path.find_last_of('.')) + ".ktx2";
+  if (!options.out_dir.empty()) {
+    out = options.out_dir + "/" + out.substr(out.find_last_of("/\\") + 1);
+  }
+  if (!WriteKtx2(out, vk_format, width, height, levels)) {
+    std::cerr << "Failed to write " << out << std::endl;
+    return false;
+  }
+  std::cout << path << " -> " << out << " (" << format << ", " << width << "x" << height
+            << ", " << levels.size() << " levels)" << std::endl;
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char const *argv[]) {
+  Options options;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      options.out_dir = argv[++i];
+    } else if (arg == "--format" && i + 1 < argc) {
+      options.format = argv[++i];
+    } else if (arg == "--flip") {
+      options.flip = true;
+    } else if (arg == "--mips" && i + 1 < argc) {
+      std::string filter = argv[++i];
+      if (filter != "box" && filter != "kaiser") {
+        std::cerr << "Unknown mip filter " << filter << std::endl;
+        return 1;
+      }
+      options.mip_filter = filter == "kaiser" ? MipFilter::kKaiser : MipFilter::kBox;
+    } else if (arg == "-h" || arg == "--help") {
+      std::cout << "Usage: texture_convert [-o dir] [--format auto|bc1|bc3|bc4|bc5] [--flip] [--mips box|kaiser] <image|dir>..." << std::endl;
+      return 0;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+  if (inputs.empty()) {
+    std::cerr << "No input, see --help" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> images;
+  for (auto &&input : inputs) {
+    if (IsDir(input)) {
+      ListImages(input, &images);
+    } else {
+      images.push_back(input);
+    }
+  }
+  std::sort(images.begin(), images.end());
+
+  int failed = 0;
+  for (auto &&image : images) {
+    if (!Convert(image, options)) failed++;
+  }
+  return failed == 0 ? 0 : 1;
+}